@@ -0,0 +1,16 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+//every module of the core includes this after its system headers, so the allocations it makes go through the profiler and are counted per frame
+//while profiling is off this costs a single flag check, profile.c itself does not include it
+
+#include<stdlib.h>
+#include<string.h>
+
+#define malloc(size) profileMalloc(size)
+#define calloc(n, size) profileCalloc(n, size)
+#define realloc(ptr, size) profileRealloc(ptr, size)
+#define strdup(s) profileStrdup(s)
+#define strndup(s, n) profileStrndup(s, n)
+
+#endif
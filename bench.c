@@ -0,0 +1,268 @@
+/*** includes ***/
+
+#include "headless.h"
+
+#include<errno.h>
+#include<fcntl.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+/*** defines ***/
+
+#define BENCH_ROWS 24
+#define BENCH_COLS 80
+#define BENCH_KEYS 2000
+//a query that never occurs in the generated text, so every search scans the whole buffer
+#define BENCH_MISS_QUERY "qzxqzxq"
+
+/*** helpers ***/
+
+static double nowMs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static size_t parseSize(const char *s){
+    //accepts plain byte counts or a K, M or G suffix
+    char *end;
+    double v = strtod(s, &end);
+    switch(*end){
+        case 'k': case 'K': v *= 1024; break;
+        case 'm': case 'M': v *= 1024 * 1024; break;
+        case 'g': case 'G': v *= 1024.0 * 1024 * 1024; break;
+    }
+    return (size_t)v;
+}
+
+static int cmpDouble(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *sorted, int n, double p){
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+//every result is printed as one json object per line so runs can be diffed and compared by scripts
+static void report(const char *input, size_t bytes, const char *metric, double value, const char *unit){
+    printf("{\"input\":\"%s\",\"bytes\":%zu,\"metric\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n", input, bytes, metric, value, unit);
+    fflush(stdout);
+}
+
+/*** input generation ***/
+
+static const char *words[] = {
+    "the", "editor", "row", "render", "buffer", "terminal", "cursor", "screen",
+    "status", "message", "search", "file", "line", "column", "byte", "key",
+    "int", "char", "return", "while", "for", "if", "else", "struct",
+};
+
+static void generateInput(const char *path, size_t size){
+    //the file is kept between runs and only regenerated when its size is off
+    struct stat st;
+    if(stat(path, &st) == 0 && (size_t)st.st_size == size)
+        return;
+
+    FILE *fp = fopen(path, "w");
+    if(!fp)
+        die("fopen");
+    //a fixed linear congruential generator keeps the text identical across runs and machines
+    unsigned long seed = 12345;
+    size_t written = 0;
+    char line[160];
+    while(written < size){
+        int len = 0;
+        int target = 20 + (seed >> 16) % 80;
+        if((seed >> 8) % 7 == 0)
+            line[len++] = '\t';
+        while(len < target){
+            seed = seed * 1103515245 + 12345;
+            const char *w = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+            int wl = strlen(w);
+            memcpy(&line[len], w, wl);
+            len += wl;
+            line[len++] = ' ';
+        }
+        line[len - 1] = '\n';
+        if(written + len > size){
+            //the last line is cut short but still ends in a newline
+            len = size - written;
+            line[len - 1] = '\n';
+        }
+        fwrite(line, 1, len, fp);
+        written += len;
+    }
+    fclose(fp);
+}
+
+/*** benchmarks ***/
+
+static void benchOpen(const char *label, const char *path, size_t bytes){
+    headlessInit(BENCH_ROWS, BENCH_COLS);
+    double t0 = nowMs();
+    editorOpen((char *)path);
+    double ms = nowMs() - t0;
+    report(label, bytes, "open_time", ms, "ms");
+    report(label, bytes, "open_throughput", bytes / (1024.0 * 1024) / (ms / 1000), "MB/s");
+}
+
+static void benchReload(const char *label, const char *path, size_t bytes){
+    //a few bytes spread over the file are changed behind the editor's back and put back afterwards, each time the file is reloaded
+    size_t at[3] = {bytes / 10, bytes / 2, bytes - bytes / 10};
+    char saved[3];
+    int fd = open(path, O_RDWR);
+    int j;
+    if(fd == -1 || bytes < 10)
+        return;
+    for(j = 0; j < 3; j++){
+        if(pread(fd, &saved[j], 1, at[j]) != 1 || pwrite(fd, saved[j] == '\n' ? "\n" : "#", 1, at[j]) != 1){
+            close(fd);
+            return;
+        }
+    }
+    double t0 = nowMs();
+    editorCheckDisk(1);
+    report(label, bytes, "reload_time", nowMs() - t0, "ms");
+    for(j = 0; j < 3; j++){
+        if(pwrite(fd, &saved[j], 1, at[j]) != 1)
+            break;
+    }
+    close(fd);
+    editorCheckDisk(1);
+}
+
+static void benchKeystrokes(const char *label, size_t bytes){
+    //a mix of typing, line splits, deletions and movement, timed from keypress to finished frame
+    static const char *keys[] = {
+        "x", "y", "z", "\r", "\x7f", "\x1b[B", "\x1b[C", "\x1b[A", "\x1b[D",
+        "\x1b[6~", "\x1b[F", "\x1b[H", "\x1b[5~", "a", "\x1b[3~",
+    };
+    int nkeys = sizeof(keys) / sizeof(keys[0]);
+    double *lat = malloc(sizeof(double) * BENCH_KEYS);
+    size_t framebytes = 0, maxframe = 0;
+    int i;
+
+    for(i = 0; i < BENCH_KEYS; i++)
+        headlessQueueKey(keys[i % nkeys], strlen(keys[i % nkeys]));
+    for(i = 0; i < BENCH_KEYS; i++){
+        double t0 = nowMs();
+        size_t n = headlessStep();
+        lat[i] = (nowMs() - t0) * 1000;
+        framebytes += n;
+        if(n > maxframe)
+            maxframe = n;
+    }
+    qsort(lat, BENCH_KEYS, sizeof(double), cmpDouble);
+    report(label, bytes, "keystroke_p50", percentile(lat, BENCH_KEYS, 0.50), "us");
+    report(label, bytes, "keystroke_p99", percentile(lat, BENCH_KEYS, 0.99), "us");
+    report(label, bytes, "frame_bytes_avg", (double)framebytes / BENCH_KEYS, "bytes");
+    report(label, bytes, "frame_bytes_max", maxframe, "bytes");
+    free(lat);
+}
+
+static void benchSearch(const char *label, size_t bytes){
+    size_t scanned = 0;
+    int j;
+    for(j = 0; j < e.numrows; j++)
+        scanned += e.row[j].rsize;
+
+    double t0 = nowMs();
+    editorFindCallback(BENCH_MISS_QUERY, 0);
+    double ms = nowMs() - t0;
+    editorFindCallback(BENCH_MISS_QUERY, '\x1b');
+    report(label, bytes, "search_time", ms, "ms");
+    report(label, bytes, "search_throughput", scanned / (1024.0 * 1024) / (ms / 1000), "MB/s");
+}
+
+static void benchSearchIndex(const char *label, size_t bytes){
+    //the search index is built (and stored) the way the idle loop builds it, then the same search goes through it
+    double t0 = nowMs();
+    trigramIdle();
+    report(label, bytes, "index_build_time", nowMs() - t0, "ms");
+    t0 = nowMs();
+    editorFindCallback(BENCH_MISS_QUERY, 0);
+    double ms = nowMs() - t0;
+    editorFindCallback(BENCH_MISS_QUERY, '\x1b');
+    report(label, bytes, "indexed_search_time", ms, "ms");
+}
+
+static void benchReplaceAll(const char *label, size_t bytes){
+    //"cursor" is one of the generated words, so every size has plenty of matches
+    int rows = 0;
+    double t0 = nowMs();
+    long count = editorReplaceAll("cursor", "caret", &rows);
+    double ms = nowMs() - t0;
+    report(label, bytes, "replace_all_time", ms, "ms");
+    report(label, bytes, "replace_all_count", count, "matches");
+    t0 = nowMs();
+    editorUndo();
+    report(label, bytes, "replace_undo_time", nowMs() - t0, "ms");
+}
+
+static void benchFilter(const char *label, size_t bytes){
+    //the whole buffer goes through cat and comes back as new rows
+    size_t total = 0;
+    int j;
+    for(j = 0; j < e.numrows; j++)
+        total += e.row[j].size + 1;
+    double t0 = nowMs();
+    editorFilterRows(0, e.numrows, "cat");
+    double ms = nowMs() - t0;
+    report(label, bytes, "filter_time", ms, "ms");
+    report(label, bytes, "filter_throughput", total / (1024.0 * 1024) / (ms / 1000), "MB/s");
+}
+
+static void benchSave(const char *label, size_t bytes, const char *outpath){
+    free(e.filename);
+    e.filename = strdup(outpath);
+    double t0 = nowMs();
+    editorSave();
+    double ms = nowMs() - t0;
+    struct stat st;
+    size_t saved = stat(outpath, &st) == 0 ? (size_t)st.st_size : 0;
+    unlink(outpath);
+    report(label, bytes, "save_time", ms, "ms");
+    report(label, bytes, "save_throughput", saved / (1024.0 * 1024) / (ms / 1000), "MB/s");
+}
+
+/*** main ***/
+
+int main(int argc, char *argv[]){
+    //inputs are generated in BENCH_DIR (default /tmp), sizes come from the command line
+    const char *dir = getenv("BENCH_DIR");
+    if(!dir)
+        dir = "/tmp";
+    if(argc < 2){
+        fprintf(stderr, "usage: bench size... (e.g. bench 1K 100M 2G)\n");
+        return 2;
+    }
+
+    int i;
+    for(i = 1; i < argc; i++){
+        size_t bytes = parseSize(argv[i]);
+        char path[4096], outpath[4096];
+        snprintf(path, sizeof(path), "%s/editor-bench-%s.txt", dir, argv[i]);
+        snprintf(outpath, sizeof(outpath), "%s/editor-bench-%s.out", dir, argv[i]);
+        generateInput(path, bytes);
+        //an index stored by an earlier run would turn the plain search below into an indexed one
+        char *index = trigramPath(path);
+        unlink(index);
+        free(index);
+
+        benchOpen(argv[i], path, bytes);
+        benchSearch(argv[i], bytes);
+        benchSearchIndex(argv[i], bytes);
+        benchReload(argv[i], path, bytes);
+        benchKeystrokes(argv[i], bytes);
+        benchReplaceAll(argv[i], bytes);
+        benchFilter(argv[i], bytes);
+        benchSave(argv[i], bytes, outpath);
+        headlessShutdown();
+        editorReset();
+    }
+    return 0;
+}
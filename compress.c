@@ -0,0 +1,456 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<errno.h>
+#include<fcntl.h>
+#include<pthread.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<zlib.h>
+#ifdef HAVE_ZSTD
+#include<zstd.h>
+#endif
+
+#include "alloc.h"
+
+/*** defines ***/
+
+//size of the chunks handed between the main thread and the (de)compression thread
+#define COMPRESS_CHUNK (1024 * 1024)
+//how many chunks may be in flight, so a fast producer can't pile up the whole file in memory
+#define COMPRESS_QUEUE_LEN 4
+//compressed input is read in pieces of this size
+#define COMPRESS_READ (256 * 1024)
+
+/*** chunk queue ***/
+
+struct chunk{
+    char *data;
+    size_t len;
+};
+
+//a bounded queue between one producer and one consumer thread
+struct chunkQueue{
+    pthread_mutex_t lock;
+    pthread_cond_t notempty;
+    pthread_cond_t notfull;
+    struct chunk items[COMPRESS_QUEUE_LEN];
+    int head;
+    int count;
+    //set by the producer once it is done, error is an errno value if it stopped early
+    int closed;
+    int error;
+};
+
+static void queueInit(struct chunkQueue *q){
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->notempty, NULL);
+    pthread_cond_init(&q->notfull, NULL);
+}
+
+static void queueDestroy(struct chunkQueue *q){
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->notempty);
+    pthread_cond_destroy(&q->notfull);
+}
+
+static void queuePush(struct chunkQueue *q, char *data, size_t len){
+    pthread_mutex_lock(&q->lock);
+    while(q->count == COMPRESS_QUEUE_LEN)
+        pthread_cond_wait(&q->notfull, &q->lock);
+    q->items[(q->head + q->count) % COMPRESS_QUEUE_LEN] = (struct chunk){data, len};
+    q->count++;
+    pthread_cond_signal(&q->notempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void queueClose(struct chunkQueue *q, int error){
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    q->error = error;
+    pthread_cond_broadcast(&q->notempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static int queuePop(struct chunkQueue *q, struct chunk *c){
+    //returns 0 once the producer has closed the queue and everything in it was taken
+    pthread_mutex_lock(&q->lock);
+    while(q->count == 0 && !q->closed)
+        pthread_cond_wait(&q->notempty, &q->lock);
+    if(q->count == 0){
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
+    *c = q->items[q->head];
+    q->head = (q->head + 1) % COMPRESS_QUEUE_LEN;
+    q->count--;
+    pthread_cond_signal(&q->notfull);
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+/*** detection ***/
+
+int compressDetect(int fd){
+    //looks at the magic bytes at the start of the file, the file offset is left alone
+    unsigned char magic[4];
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    if(n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return COMPRESS_GZIP;
+    if(n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return COMPRESS_ZSTD;
+    return COMPRESS_NONE;
+}
+
+int compressSupported(int type){
+#ifdef HAVE_ZSTD
+    (void)type;
+    return 1;
+#else
+    return type != COMPRESS_ZSTD;
+#endif
+}
+
+/*** decompression ***/
+
+struct decompressJob{
+    int fd;
+    int type;
+    struct chunkQueue queue;
+};
+
+static int decompressGzip(struct decompressJob *job){
+    //inflates every gzip member in the file, concatenated .gz files are valid and common for rotated logs
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    //15 + 32 lets zlib detect the gzip header by itself
+    if(inflateInit2(&zs, 15 + 32) != Z_OK)
+        return ENOMEM;
+    char *in = malloc(COMPRESS_READ);
+    char *out = malloc(COMPRESS_CHUNK);
+    int err = 0, ret = Z_OK;
+    ssize_t n;
+    while(!err && (n = read(job->fd, in, COMPRESS_READ)) > 0){
+        zs.next_in = (Bytef *)in;
+        zs.avail_in = n;
+        //keeps inflating while there is input left or the last call filled the whole output buffer
+        do{
+            zs.next_out = (Bytef *)out;
+            zs.avail_out = COMPRESS_CHUNK;
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR){
+                err = EILSEQ;
+                break;
+            }
+            size_t have = COMPRESS_CHUNK - zs.avail_out;
+            if(have){
+                //the full buffer goes to the consumer and a fresh one is used for the next piece
+                queuePush(&job->queue, out, have);
+                out = malloc(COMPRESS_CHUNK);
+            }
+            if(ret == Z_STREAM_END)
+                inflateReset(&zs);
+            else if(ret == Z_BUF_ERROR)
+                break;
+        }while(zs.avail_in > 0 || zs.avail_out == 0);
+    }
+    if(!err && n < 0)
+        err = errno;
+    //a member that was cut off still leaves the decoded part in the buffer, but it is reported
+    if(!err && ret != Z_STREAM_END && zs.total_in != 0)
+        err = EILSEQ;
+    inflateEnd(&zs);
+    free(in);
+    free(out);
+    return err;
+}
+
+#ifdef HAVE_ZSTD
+static int decompressZstd(struct decompressJob *job){
+    ZSTD_DStream *ds = ZSTD_createDStream();
+    if(!ds)
+        return ENOMEM;
+    ZSTD_initDStream(ds);
+    char *in = malloc(COMPRESS_READ);
+    char *out = malloc(COMPRESS_CHUNK);
+    int err = 0;
+    size_t ret = 0;
+    ssize_t n;
+    while(!err && (n = read(job->fd, in, COMPRESS_READ)) > 0){
+        ZSTD_inBuffer ib = {in, n, 0};
+        ZSTD_outBuffer ob;
+        //a full output buffer may mean more output is pending even once the input is used up
+        do{
+            ob = (ZSTD_outBuffer){out, COMPRESS_CHUNK, 0};
+            ret = ZSTD_decompressStream(ds, &ob, &ib);
+            if(ZSTD_isError(ret)){
+                err = EILSEQ;
+                break;
+            }
+            if(ob.pos){
+                queuePush(&job->queue, out, ob.pos);
+                out = malloc(COMPRESS_CHUNK);
+            }
+        }while(ib.pos < ib.size || ob.pos == ob.size);
+    }
+    if(!err && n < 0)
+        err = errno;
+    //a non-zero hint at the end of the input means the last frame is incomplete
+    if(!err && ret != 0)
+        err = EILSEQ;
+    ZSTD_freeDStream(ds);
+    free(in);
+    free(out);
+    return err;
+}
+#endif
+
+static void *decompressWorker(void *arg){
+    struct decompressJob *job = arg;
+    int err = ENOTSUP;
+    if(job->type == COMPRESS_GZIP)
+        err = decompressGzip(job);
+#ifdef HAVE_ZSTD
+    else if(job->type == COMPRESS_ZSTD)
+        err = decompressZstd(job);
+#endif
+    queueClose(&job->queue, err);
+    return NULL;
+}
+
+static void compressInsertLine(char *s, size_t len){
+    while(len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r'))
+        len--;
+    editorInsertRow(e.numrows, s, len);
+}
+
+int compressLoad(int fd, int type){
+    //decodes fd on a background thread while this thread splits the decoded chunks into rows
+    //returns 0 or an errno value, rows decoded before an error are kept
+    struct decompressJob job;
+    job.fd = fd;
+    job.type = type;
+    queueInit(&job.queue);
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, decompressWorker, &job) != 0){
+        queueDestroy(&job.queue);
+        return EAGAIN;
+    }
+
+    //a line that straddles two chunks is carried over until its newline shows up
+    char *carry = NULL;
+    size_t carrylen = 0, carrycap = 0;
+    struct chunk c;
+    while(queuePop(&job.queue, &c)){
+        char *p = c.data, *end = c.data + c.len;
+        while(p < end){
+            char *nl = memchr(p, '\n', end - p);
+            if(!nl){
+                if(carrylen + (end - p) > carrycap){
+                    carrycap = (carrylen + (end - p)) * 2;
+                    carry = realloc(carry, carrycap);
+                }
+                memcpy(carry + carrylen, p, end - p);
+                carrylen += end - p;
+                break;
+            }
+            if(carrylen){
+                if(carrylen + (nl - p) > carrycap){
+                    carrycap = (carrylen + (nl - p)) * 2;
+                    carry = realloc(carry, carrycap);
+                }
+                memcpy(carry + carrylen, p, nl - p);
+                compressInsertLine(carry, carrylen + (nl - p));
+                carrylen = 0;
+            }
+            else{
+                compressInsertLine(p, nl - p);
+            }
+            p = nl + 1;
+        }
+        free(c.data);
+    }
+    if(carrylen)
+        compressInsertLine(carry, carrylen);
+    free(carry);
+
+    pthread_join(thread, NULL);
+    int err = job.queue.error;
+    queueDestroy(&job.queue);
+    return err;
+}
+
+/*** compression ***/
+
+struct compressJob{
+    int fd;
+    int type;
+    struct chunkQueue queue;
+    size_t written;
+    int error;
+};
+
+static int writeAll(int fd, const char *buf, size_t len){
+    while(len > 0){
+        ssize_t n = write(fd, buf, len);
+        if(n == -1 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return n == 0 ? EIO : errno;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int compressGzip(struct compressJob *job){
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    //15 + 16 asks zlib for a gzip header and trailer instead of a raw zlib stream
+    if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return ENOMEM;
+    char *out = malloc(COMPRESS_CHUNK);
+    int err = 0, more = 1;
+    struct chunk c;
+    while(more){
+        more = queuePop(&job->queue, &c);
+        zs.next_in = more ? (Bytef *)c.data : NULL;
+        zs.avail_in = more ? c.len : 0;
+        int flush = more ? Z_NO_FLUSH : Z_FINISH;
+        //with Z_FINISH, deflate is done once it leaves room in the output buffer
+        do{
+            zs.next_out = (Bytef *)out;
+            zs.avail_out = COMPRESS_CHUNK;
+            deflate(&zs, flush);
+            size_t have = COMPRESS_CHUNK - zs.avail_out;
+            //after a write error the remaining chunks are still drained so the producer never blocks
+            if(!err && have){
+                err = writeAll(job->fd, out, have);
+                job->written += have;
+            }
+        }while(zs.avail_out == 0);
+        if(more)
+            free(c.data);
+    }
+    deflateEnd(&zs);
+    free(out);
+    return err;
+}
+
+#ifdef HAVE_ZSTD
+static int compressZstd(struct compressJob *job){
+    ZSTD_CStream *cs = ZSTD_createCStream();
+    if(!cs)
+        return ENOMEM;
+    ZSTD_initCStream(cs, 3);
+    char *out = malloc(COMPRESS_CHUNK);
+    int err = 0;
+    struct chunk c;
+    int more;
+    do{
+        more = queuePop(&job->queue, &c);
+        ZSTD_inBuffer ib = {more ? c.data : NULL, more ? c.len : 0, 0};
+        size_t remaining;
+        do{
+            ZSTD_outBuffer ob = {out, COMPRESS_CHUNK, 0};
+            remaining = ZSTD_compressStream2(cs, &ob, &ib, more ? ZSTD_e_continue : ZSTD_e_end);
+            if(ZSTD_isError(remaining)){
+                err = EIO;
+                break;
+            }
+            if(!err && ob.pos){
+                err = writeAll(job->fd, out, ob.pos);
+                job->written += ob.pos;
+            }
+        }while(more ? ib.pos < ib.size : remaining != 0);
+        if(more)
+            free(c.data);
+    }while(more);
+    ZSTD_freeCStream(cs);
+    free(out);
+    return err;
+}
+#endif
+
+static void *compressWorker(void *arg){
+    struct compressJob *job = arg;
+    int err = ENOTSUP;
+    if(job->type == COMPRESS_GZIP)
+        err = compressGzip(job);
+#ifdef HAVE_ZSTD
+    else if(job->type == COMPRESS_ZSTD)
+        err = compressZstd(job);
+#endif
+    job->error = err;
+    return NULL;
+}
+
+int compressSave(const char *filename, int type, size_t *written){
+    //rows are serialized into chunks on this thread and compressed and written on a background thread
+    //returns 0 on success, otherwise errno is set and -1 returned
+    if(!compressSupported(type)){
+        errno = ENOTSUP;
+        return -1;
+    }
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if(fd == -1)
+        return -1;
+    if(ftruncate(fd, 0) == -1){
+        close(fd);
+        return -1;
+    }
+
+    struct compressJob job;
+    job.fd = fd;
+    job.type = type;
+    job.written = 0;
+    queueInit(&job.queue);
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, compressWorker, &job) != 0){
+        queueDestroy(&job.queue);
+        close(fd);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    char *buf = malloc(COMPRESS_CHUNK);
+    size_t len = 0, cap = COMPRESS_CHUNK;
+    int j;
+    for(j = 0; j < e.numrows; j++){
+        erow *row = &e.row[j];
+        if(len + row->size + 1 > cap && len > 0){
+            queuePush(&job.queue, buf, len);
+            buf = malloc(COMPRESS_CHUNK);
+            len = 0;
+            cap = COMPRESS_CHUNK;
+        }
+        //a single row longer than a chunk gets a chunk of its own
+        if(row->size + 1 > (int)cap){
+            cap = row->size + 1;
+            buf = realloc(buf, cap);
+        }
+        memcpy(buf + len, row->chars, row->size);
+        len += row->size;
+        buf[len++] = '\n';
+    }
+    if(len > 0)
+        queuePush(&job.queue, buf, len);
+    else
+        free(buf);
+    queueClose(&job.queue, 0);
+    pthread_join(thread, NULL);
+
+    int err = job.error;
+    queueDestroy(&job.queue);
+    if(close(fd) == -1 && !err)
+        err = errno;
+    if(err){
+        errno = err;
+        return -1;
+    }
+    *written = job.written;
+    return 0;
+}
@@ -0,0 +1,530 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<ctype.h>
+#include<stdlib.h>
+#include<string.h>
+
+#include "alloc.h"
+
+/*** data ***/
+
+//a range of characters [s, e) on row y that one keystroke applies to, s == e for a plain cursor
+struct span{
+    int y;
+    int s;
+    int e;
+    //set on the span that belongs to the primary cursor (e.cx, e.cy)
+    int primary;
+};
+
+//set while a batch edit updates the cursors itself, so the row insert/delete hooks leave them alone
+static int cursors_batching = 0;
+
+/*** helpers ***/
+
+static int cmpCursor(const void *a, const void *b){
+    const cursor *x = a, *y = b;
+    if(x->cy != y->cy)
+        return x->cy - y->cy;
+    return x->cx - y->cx;
+}
+
+static int cmpSpan(const void *a, const void *b){
+    const struct span *x = a, *y = b;
+    if(x->y != y->y)
+        return x->y - y->y;
+    return x->s - y->s;
+}
+
+static void cursorsNormalize(){
+    //keeps the extra cursors sorted, clamped to their rows and without duplicates or one on top of the primary cursor
+    int i, n = 0;
+    for(i = 0; i < e.numcursors; i++){
+        cursor *c = &e.cursors[i];
+        if(c->cy > e.numrows)
+            c->cy = e.numrows;
+        if(c->cy < 0)
+            c->cy = 0;
+        int rowlen = c->cy < e.numrows ? e.row[c->cy].size : 0;
+        if(c->cx > rowlen)
+            c->cx = rowlen;
+        if(c->cx < 0)
+            c->cx = 0;
+    }
+    if(e.numcursors > 1)
+        qsort(e.cursors, e.numcursors, sizeof(cursor), cmpCursor);
+    for(i = 0; i < e.numcursors; i++){
+        cursor *c = &e.cursors[i];
+        if(c->cx == e.cx && c->cy == e.cy)
+            continue;
+        if(n > 0 && e.cursors[n - 1].cx == c->cx && e.cursors[n - 1].cy == c->cy)
+            continue;
+        e.cursors[n++] = *c;
+    }
+    e.numcursors = n;
+}
+
+static void cursorsAdd(int cx, int cy){
+    e.cursors = realloc(e.cursors, sizeof(cursor) * (e.numcursors + 1));
+    e.cursors[e.numcursors].cx = cx;
+    e.cursors[e.numcursors].cy = cy;
+    e.numcursors++;
+}
+
+int cursorsActive(){
+    return e.numcursors > 0 || e.sely != -1;
+}
+
+void cursorsClear(){
+    free(e.cursors);
+    e.cursors = NULL;
+    e.numcursors = 0;
+    e.sely = -1;
+}
+
+static void cursorsSelection(int *x0, int *y0, int *x1, int *y1){
+    //corners of the column selection, x1 is exclusive
+    *y0 = e.sely < e.cy ? e.sely : e.cy;
+    *y1 = e.sely < e.cy ? e.cy : e.sely;
+    *x0 = e.selx < e.selcol ? e.selx : e.selcol;
+    *x1 = e.selx < e.selcol ? e.selcol : e.selx;
+}
+
+static int cursorsCollect(struct span **out){
+    //turns the column selection, or else every cursor, into spans sorted by position
+    int n = 0, i;
+    struct span *spans;
+    if(e.sely != -1){
+        int x0, y0, x1, y1;
+        cursorsSelection(&x0, &y0, &x1, &y1);
+        if(y1 >= e.numrows)
+            y1 = e.numrows - 1;
+        spans = malloc(sizeof(struct span) * (y1 - y0 + 2));
+        for(i = y0; i <= y1; i++){
+            //rows that end left of the selection are left alone, unless the selection is only a column, then they get a cursor at their end
+            int size = e.row[i].size;
+            if(x1 > x0 && size <= x0)
+                continue;
+            spans[n].y = i;
+            spans[n].s = x0 < size ? x0 : size;
+            spans[n].e = x1 < size ? x1 : size;
+            spans[n].primary = (i == e.cy);
+            n++;
+        }
+        if(n == 0){
+            spans[n++] = (struct span){e.cy, e.cx, e.cx, 1};
+        }
+    }
+    else{
+        spans = malloc(sizeof(struct span) * (e.numcursors + 1));
+        for(i = 0; i < e.numcursors; i++)
+            spans[n++] = (struct span){e.cursors[i].cy, e.cursors[i].cx, e.cursors[i].cx, 0};
+        spans[n++] = (struct span){e.cy, e.cx, e.cx, 1};
+        qsort(spans, n, sizeof(struct span), cmpSpan);
+    }
+    *out = spans;
+    return n;
+}
+
+static void cursorsStore(cursor *pos, int n, int primary){
+    //pos holds the new position of every cursor, pos[primary] becomes (e.cx, e.cy) and the rest the extra cursors
+    int i, m = 0;
+    e.cx = pos[primary].cx;
+    e.cy = pos[primary].cy;
+    e.cursors = realloc(e.cursors, sizeof(cursor) * (n > 1 ? n - 1 : 1));
+    for(i = 0; i < n; i++){
+        if(i != primary)
+            e.cursors[m++] = pos[i];
+    }
+    e.numcursors = m;
+    e.sely = -1;
+    cursorsNormalize();
+}
+
+/*** batched edits ***/
+
+enum cursorsEdit{
+    CURSORS_INSERT,
+    CURSORS_BACKSPACE,
+    CURSORS_DELETE
+};
+
+static void cursorsEditRow(erow *row, struct span *spans, int n, int kind, const char *text, int textlen, cursor *newpos){
+    //applies one keystroke to every span on this row, rebuilding the row in a single allocation and rendering it once
+    //newpos receives where each span's cursor ends up
+    int y = row - e.row;
+    int i;
+    //the characters of the row each span removes, worked out before anything changes
+    int *ds = malloc(sizeof(int) * n);
+    int *de = malloc(sizeof(int) * n);
+    int removed = 0, consumed = 0;
+    for(i = 0; i < n; i++){
+        int s = spans[i].s, en = spans[i].e;
+        if(s == en && kind == CURSORS_BACKSPACE && s > consumed)
+            s--;
+        else if(s == en && kind == CURSORS_DELETE && en < row->size)
+            en++;
+        if(s < consumed)
+            s = consumed;
+        if(en < s)
+            en = s;
+        ds[i] = s;
+        de[i] = en;
+        consumed = en;
+        removed += en - s;
+    }
+    int inserted = kind == CURSORS_INSERT ? textlen * n : 0;
+    int newsize = row->size - removed + inserted;
+    char *chars = malloc(newsize + 1);
+    int src = 0, dst = 0;
+    for(i = 0; i < n; i++){
+        memcpy(chars + dst, row->chars + src, ds[i] - src);
+        dst += ds[i] - src;
+        if(kind == CURSORS_INSERT){
+            memcpy(chars + dst, text, textlen);
+            dst += textlen;
+        }
+        newpos[i].cx = dst;
+        newpos[i].cy = y;
+        src = de[i];
+    }
+    memcpy(chars + dst, row->chars + src, row->size - src);
+    chars[newsize] = '\0';
+
+    //the journal gets the same edit as plain row operations, right to left so earlier positions stay valid on replay
+    for(i = n - 1; i >= 0; i--){
+        if(de[i] > ds[i])
+            journalRecord(JOURNAL_DEL_RANGE, y, ds[i], NULL, de[i] - ds[i]);
+        if(kind == CURSORS_INSERT)
+            journalRecord(JOURNAL_INSERT_STR, y, ds[i], text, textlen);
+    }
+
+    free(row->chars);
+    row->chars = chars;
+    row->size = newsize;
+    editorUpdateRow(row);
+    e.dirty++;
+    free(ds);
+    free(de);
+}
+
+static void cursorsApplyEdit(int kind, const char *text, int textlen){
+    struct span *spans;
+    int n = cursorsCollect(&spans);
+    cursor *newpos = malloc(sizeof(cursor) * n);
+    int primary = 0;
+    int i, j, k;
+
+    //a cursor on the line past the end of the file types into a new last row, like editorInsertChar does
+    if(kind == CURSORS_INSERT && spans[n - 1].y == e.numrows)
+        editorInsertRow(e.numrows, "", 0);
+
+    cursors_batching = 1;
+    for(i = 0; i < n; i = j){
+        //spans on the same row are applied together
+        for(j = i; j < n && spans[j].y == spans[i].y; j++)
+            ;
+        if(spans[i].y < e.numrows){
+            cursorsEditRow(&e.row[spans[i].y], &spans[i], j - i, kind, text, textlen, &newpos[i]);
+        }
+        else{
+            for(k = i; k < j; k++)
+                newpos[k] = (cursor){0, spans[k].y};
+        }
+    }
+    cursors_batching = 0;
+    for(i = 0; i < n; i++){
+        if(spans[i].primary)
+            primary = i;
+    }
+    cursorsStore(newpos, n, primary);
+    free(newpos);
+    free(spans);
+}
+
+static void cursorsNewLine(){
+    //splits every row at each of its cursors, building the new row array in one pass instead of one memmove per inserted row
+    struct span *spans;
+    int n = cursorsCollect(&spans);
+    cursor *newpos = malloc(sizeof(cursor) * n);
+    int primary = 0;
+    int i, j, k;
+
+    //a selection is removed first, what's left is a cursor at the start of each span
+    if(e.sely != -1){
+        free(spans);
+        cursorsApplyEdit(CURSORS_INSERT, "", 0);
+        n = cursorsCollect(&spans);
+        newpos = realloc(newpos, sizeof(cursor) * n);
+    }
+
+    //cursors on the line past the end of the file only need an empty row each
+    int extra = 0;
+    for(i = 0; i < n; i++){
+        if(spans[i].y < e.numrows)
+            extra++;
+    }
+    int oldrows = e.numrows;
+    erow *rows = malloc(sizeof(erow) * (oldrows + extra + 1));
+    int out = 0, next = 0;
+
+    cursors_batching = 1;
+    for(i = 0; i < n; i = j){
+        int y = spans[i].y;
+        for(j = i; j < n && spans[j].y == y; j++)
+            ;
+        if(y >= oldrows)
+            break;
+        //rows without a cursor move over unchanged
+        memcpy(&rows[out], &e.row[next], sizeof(erow) * (y - next));
+        out += y - next;
+        next = y + 1;
+
+        erow *row = &e.row[y];
+        int first = out;
+        //journal records describe the split as plain row operations on the rows as they are at this point
+        for(k = i; k < j; k++){
+            int x = spans[k].s;
+            if(k == i){
+                //the first piece stays where the row was and keeps its search block, the pieces after it are filed when the inserts are announced
+                rows[out] = *row;
+                rows[out].chars = malloc(x + 1);
+                memcpy(rows[out].chars, row->chars, x);
+                rows[out].chars[x] = '\0';
+                rows[out].size = x;
+                rows[out].render = NULL;
+                rows[out].fields = NULL;
+                rows[out].numfields = 0;
+            }
+            int end = (k + 1 < j) ? spans[k + 1].s : row->size;
+            out++;
+            rows[out].size = end - x;
+            rows[out].chars = malloc(end - x + 1);
+            memcpy(rows[out].chars, row->chars + x, end - x);
+            rows[out].chars[end - x] = '\0';
+            rows[out].render = NULL;
+            rows[out].rsize = 0;
+            rows[out].fields = NULL;
+            rows[out].numfields = 0;
+            rows[out].block = -1;
+            newpos[k] = (cursor){0, out};
+        }
+        int at = first;
+        if(row->size > spans[i].s)
+            journalRecord(JOURNAL_DEL_RANGE, at, spans[i].s, NULL, row->size - spans[i].s);
+        for(k = i; k < j; k++)
+            journalRecord(JOURNAL_INSERT_ROW, at + 1 + (k - i), 0, rows[at + 1 + (k - i)].chars, rows[at + 1 + (k - i)].size);
+        editorFreeRow(row);
+        for(k = first; k <= out; k++){
+            free(rows[k].render);
+            rows[k].render = NULL;
+            editorUpdateRow(&rows[k]);
+        }
+        out++;
+    }
+    memcpy(&rows[out], &e.row[next], sizeof(erow) * (oldrows - next));
+    out += oldrows - next;
+    free(e.row);
+    e.row = rows;
+    e.numrows = out;
+    //the other modules hear about the new rows in order, top to bottom
+    int inserted = 0;
+    for(k = 0; k < n && spans[k].y < oldrows; k++){
+        editorRowsInserted(spans[k].y + inserted + 1, 1);
+        inserted++;
+    }
+    //a cursor past the end of the file becomes an empty row of its own
+    for(; i < n; i++){
+        editorInsertRow(e.numrows, "", 0);
+        newpos[i] = (cursor){0, e.numrows};
+    }
+    cursors_batching = 0;
+    e.dirty++;
+
+    for(i = 0; i < n; i++){
+        if(spans[i].primary)
+            primary = i;
+    }
+    cursorsStore(newpos, n, primary);
+    free(newpos);
+    free(spans);
+}
+
+static void cursorsMove(int key){
+    //moves every cursor the way editorMoveCursor moves the primary one
+    int i;
+    int cx = e.cx, cy = e.cy;
+    for(i = 0; i < e.numcursors; i++){
+        e.cx = e.cursors[i].cx;
+        e.cy = e.cursors[i].cy;
+        if(key == HOME_KEY)
+            e.cx = 0;
+        else if(key == END_KEY)
+            e.cx = e.cy < e.numrows ? e.row[e.cy].size : 0;
+        else
+            editorMoveCursor(key);
+        e.cursors[i].cx = e.cx;
+        e.cursors[i].cy = e.cy;
+    }
+    e.cx = cx;
+    e.cy = cy;
+    if(key == HOME_KEY)
+        e.cx = 0;
+    else if(key == END_KEY)
+        e.cx = e.cy < e.numrows ? e.row[e.cy].size : 0;
+    else
+        editorMoveCursor(key);
+    cursorsNormalize();
+}
+
+/*** multiple cursors ***/
+
+void cursorsAddBelow(){
+    //leaves a cursor where the primary one is and moves the primary one down a line
+    if(e.cy >= e.numrows - 1)
+        return;
+    e.sely = -1;
+    cursorsAdd(e.cx, e.cy);
+    editorMoveCursor(ARROW_DOWN);
+    cursorsNormalize();
+}
+
+void cursorsExtendSelection(int key){
+    //shift + arrow keys grow a rectangular selection from where the first one was pressed
+    if(e.sely == -1){
+        free(e.cursors);
+        e.cursors = NULL;
+        e.numcursors = 0;
+        e.selx = e.cx;
+        e.sely = e.cy;
+        e.selcol = e.cx;
+    }
+    int rowlen = e.cy < e.numrows ? e.row[e.cy].size : 0;
+    switch(key){
+        case SHIFT_ARROW_UP:
+            if(e.cy > 0)
+                e.cy--;
+            break;
+        case SHIFT_ARROW_DOWN:
+            if(e.cy < e.numrows - 1)
+                e.cy++;
+            break;
+        case SHIFT_ARROW_LEFT:
+            if(e.selcol > 0)
+                e.selcol--;
+            break;
+        case SHIFT_ARROW_RIGHT:
+            //the column grows as far as the end of the row the cursor is on
+            if(e.selcol < rowlen)
+                e.selcol++;
+            break;
+    }
+    //unlike plain cursor movement the column is kept on short rows, so the rectangle keeps its shape, the cursor itself stops at the end of the row
+    rowlen = e.cy < e.numrows ? e.row[e.cy].size : 0;
+    e.cx = e.selcol < rowlen ? e.selcol : rowlen;
+}
+
+int cursorsProcessKey(int c){
+    //handles a key while there are extra cursors or a column selection, returns 0 for keys it leaves to editorProcessKeypress
+    switch(c){
+        case '\x1b':
+            cursorsClear();
+            return 1;
+        case '\r':
+            cursorsNewLine();
+            return 1;
+        case BACKSPACE:
+        case CTRL_KEY('h'):
+            cursorsApplyEdit(CURSORS_BACKSPACE, NULL, 0);
+            return 1;
+        case DEL_KEY:
+            cursorsApplyEdit(CURSORS_DELETE, NULL, 0);
+            return 1;
+        case ARROW_LEFT:
+        case ARROW_RIGHT:
+        case ARROW_UP:
+        case ARROW_DOWN:
+        case HOME_KEY:
+        case END_KEY:
+            //plain movement drops a selection and moves every cursor
+            e.sely = -1;
+            cursorsMove(c);
+            return 1;
+    }
+    if(c == '\t' || (!iscntrl(c) && c < 128)){
+        char ch = c;
+        cursorsApplyEdit(CURSORS_INSERT, &ch, 1);
+        return 1;
+    }
+    return 0;
+}
+
+void cursorsRowsInserted(int at, int n){
+    //keeps extra cursors on the same text when rows are inserted above them
+    int i;
+    if(cursors_batching)
+        return;
+    for(i = 0; i < e.numcursors; i++){
+        if(e.cursors[i].cy >= at)
+            e.cursors[i].cy += n;
+    }
+    if(e.sely != -1 && e.sely >= at)
+        e.sely += n;
+}
+
+void cursorsRowsDeleted(int at, int n){
+    //cursors on deleted rows end up at the start of the row that took their place
+    int i;
+    if(cursors_batching)
+        return;
+    for(i = 0; i < e.numcursors; i++){
+        if(e.cursors[i].cy >= at + n){
+            e.cursors[i].cy -= n;
+        }
+        else if(e.cursors[i].cy >= at){
+            e.cursors[i].cy = at;
+            e.cursors[i].cx = 0;
+        }
+    }
+    if(e.sely != -1 && e.sely >= at)
+        e.sely = e.sely >= at + n ? e.sely - n : at;
+    cursorsNormalize();
+}
+
+/*** drawing ***/
+
+int cursorsRowMarks(int filerow, int *start, int *end, int max){
+    //render columns [start, end) to highlight on filerow, one per extra cursor or the selection's stretch of the row
+    int n = 0;
+    erow *row = &e.row[filerow];
+    if(e.sely != -1){
+        int x0, y0, x1, y1;
+        cursorsSelection(&x0, &y0, &x1, &y1);
+        if(filerow < y0 || filerow > y1)
+            return 0;
+        int s = editorRowCxtoRx(row, x0 < row->size ? x0 : row->size);
+        int en = editorRowCxtoRx(row, x1 < row->size ? x1 : row->size);
+        start[0] = s;
+        //an empty selection still shows where the column is
+        end[0] = en > s ? en : s + 1;
+        return 1;
+    }
+    //binary search for the first extra cursor on this row
+    int lo = 0, hi = e.numcursors;
+    while(lo < hi){
+        int mid = (lo + hi) / 2;
+        if(e.cursors[mid].cy < filerow)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for(; lo < e.numcursors && e.cursors[lo].cy == filerow && n < max; lo++){
+        int cx = e.cursors[lo].cx < row->size ? e.cursors[lo].cx : row->size;
+        start[n] = editorRowCxtoRx(row, cx);
+        end[n] = start[n] + 1;
+        n++;
+    }
+    return n;
+}
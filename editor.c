@@ -1,8 +1,6 @@
 /*** includes ***/
 
-#define _DEFAULT_SOURCE
-#define _BSD_SOURCE
-#define _GNU_SOURCE
+#include "editor.h"
 
 #include<ctype.h>
 #include<errno.h>
@@ -10,78 +8,20 @@
 #include<stdarg.h>
 #include<stdio.h>
 #include<stdlib.h>
+#include<poll.h>
 #include<string.h>
 #include<sys/ioctl.h>
-#include<sys/types.h>
-#include<termios.h>
-#include<time.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/uio.h>
 #include<unistd.h>
 
-/*** defines ***/
-
-//CTRL_KEY macro bitwise ANDs a character with the value 00011111 in binary, this mirrors the function of a ctrl key in the terminal, stripping away bits 5 and 6 from whatever key you press in combination with ctrl
-#define CTRL_KEY(k) ((k) & 0x1f)
-
-#define EDITOR_VERSION "0.0.1"
-#define TAB_STOP 8
-#define QUIT_TIMES 3
-
-enum editorKey{
-    //the rest would be set to incrementing values automatically
-    BACKSPACE = 127,
-    ARROW_LEFT = 1000,
-    ARROW_RIGHT,
-    ARROW_DOWN,
-    ARROW_UP,
-    DEL_KEY,
-    HOME_KEY,
-    END_KEY,
-    PAGE_UP,
-    PAGE_DOWN
-};
+#include "alloc.h"
 
 /*** data ***/
 
-typedef struct erow{
-    //struct to store a row of data
-
-    int size;
-    int rsize;
-    char *chars;
-    char *render;
-}erow; //editor row
-
-struct editorConfig{
-
-    //current position of the cursor
-    int cx, cy;
-    int rx;
-    //rowoff and coloff keeps track of the row and the column of the file the user is currently scrolled to
-    int rowoff;
-    int coloff;
-    //for the number of rows and columns on screen
-    int screenrows;
-    int screencols;
-
-    int numrows;
-    erow *row;
-
-    int dirty;
-    char *filename;
-    char statusmsg[80];
-    time_t statusmsg_time;
-    //stores the configuration of the original terminal
-    struct termios orig_termios;
-};
-
 struct editorConfig e;
 
-/*** prototypes ***/
-
-void editorSetStatusMessage(const char *fmt, ...);
-void editorRefreshScreen();
-char *editorPrompt(char *prompt, void (*callback)(char *, int));
-
 /*** terminal ***/
 
 void die(const char *s){
@@ -155,23 +95,51 @@ int editorReadKey(){
     //reads one byte from the standard input into character variable c
     //read returns the number of bytes that it reads
     //in case of error, error code 'read' is sent to die() function
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1){
-        if (nread == -1 && errno != EAGAIN)
+    profileBegin(PROF_READ);
+    while ((nread = read(e.ifd, &c, 1)) != 1){
+        if (nread == -1 && errno != EAGAIN && errno != EINTR)
             die("read");
+        //read times out every 100 ms while no key is pressed, which is when background work gets done
+        if (nread == 0 || errno == EINTR)
+            editorIdle();
+        //a headless driver queues its next scripted key only once the previous one has been consumed, so that a lone escape still times out like it does on a terminal
+        if (nread == 0 && e.headless && !e.keysource()){
+            errno = 0;
+            die("editorReadKey: key script exhausted");
+        }
     }
+    profileEnd(PROF_READ);
     //checking if c is an escape character
     if (c == '\x1b'){
-        char seq[3];
+        char seq[5];
         //to check if it is an escape character
-        if (read(STDIN_FILENO, &seq[0], 1) != 1)
+        if (read(e.ifd, &seq[0], 1) != 1)
             return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1)
+        if (read(e.ifd, &seq[1], 1) != 1)
             return '\x1b';
         
         if (seq[0] == '['){
             if (seq[1] >= '0' && seq[1] <= '9'){
-                if (read(STDIN_FILENO, &seq[2], 1) != 1)
+                if (read(e.ifd, &seq[2], 1) != 1)
+                    return '\x1b';
+                //xterm sends shift + arrow as ESC [ 1 ; 2 A, the 2 being the shift modifier
+                if (seq[2] == ';'){
+                    if (read(e.ifd, &seq[3], 1) != 1 || read(e.ifd, &seq[4], 1) != 1)
+                        return '\x1b';
+                    if (seq[1] == '1' && seq[3] == '2'){
+                        switch (seq[4]){
+                            case 'A':
+                                return SHIFT_ARROW_UP;
+                            case 'B':
+                                return SHIFT_ARROW_DOWN;
+                            case 'C':
+                                return SHIFT_ARROW_RIGHT;
+                            case 'D':
+                                return SHIFT_ARROW_LEFT;
+                        }
+                    }
                     return '\x1b';
+                }
                 if (seq[2] == '~'){
                     switch (seq[1]){
                         case '1':
@@ -226,6 +194,16 @@ int editorReadKey(){
     }
 }
 
+void editorIdle(){
+    //called while the editor is waiting for a key
+    profileBegin(PROF_IDLE);
+    journalIdle();
+    editorCheckDisk(0);
+    tableIdle();
+    trigramIdle();
+    profileEnd(PROF_IDLE);
+}
+
 int getCursorPosition(int *rows, int *columns){
 
     char buf[32];
@@ -328,6 +306,29 @@ void editorUpdateRow(erow *row){
     }
     row->render[idx] = '\0';
     row->rsize = idx;
+
+    //the fields have moved, so the table view splits the row again the next time it is drawn
+    free(row->fields);
+    row->fields = NULL;
+    row->numfields = 0;
+    if(tableActive())
+        tableRowChanged(row);
+    trigramRowChanged(row);
+}
+
+void editorRowsInserted(int at, int n){
+    //n rows were inserted at at, everything that remembers row numbers is told here
+    cursorsRowsInserted(at, n);
+    foldRowsInserted(at, n);
+    tableRowsInserted(at, n);
+    trigramRowsInserted(at, n);
+}
+
+void editorRowsDeleted(int at, int n){
+    //n rows starting at at were deleted
+    cursorsRowsDeleted(at, n);
+    foldRowsDeleted(at, n);
+    tableRowsDeleted(at, n);
 }
 
 void editorInsertRow(int at, char *s, size_t len){
@@ -346,53 +347,70 @@ void editorInsertRow(int at, char *s, size_t len){
 
     e.row[at].rsize = 0;
     e.row[at].render = NULL;
+    e.row[at].fields = NULL;
+    e.row[at].numfields = 0;
+    e.row[at].block = -1;
     editorUpdateRow(&e.row[at]);
 
     e.numrows++;
     e.dirty++;
+    journalRecord(JOURNAL_INSERT_ROW, at, 0, s, len);
+    editorRowsInserted(at, 1);
 }
 
 void editorFreeRow(erow *row){
     free(row->render);
     free(row->chars);
+    free(row->fields);
 }
 
 void editorDelRow(int at){
-    if(at < 0 || at > e.numrows)
+    if(at < 0 || at >= e.numrows)
         return;
     editorFreeRow(&e.row[at]);
-    memmove(&e.row[at], &e.row[at + 1], sizeof(e.row) * (e.numrows - at - 1));
+    memmove(&e.row[at], &e.row[at + 1], sizeof(erow) * (e.numrows - at - 1));
     e.numrows--;
     e.dirty++;
+    journalRecord(JOURNAL_DEL_ROW, at, 0, NULL, 0);
+    editorRowsDeleted(at, 1);
 }
 
-void editorRowInsertChar(erow *row, int at, int c){
+void editorRowInsertString(erow *row, int at, char *s, size_t len){
     if(at < 0 || at > row->size)
         at = row->size;
-    row->chars = realloc(row->chars, row->size + 2); //allocated 2 more bytes for the end null byte
-    memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-    row->size++;
-    row->chars[at] = c; //asign the character to its position in the array
+    row->chars = realloc(row->chars, row->size + len + 1); //allocated 1 more byte for the end null byte
+    memmove(&row->chars[at + len], &row->chars[at], row->size - at + 1);
+    memcpy(&row->chars[at], s, len);
+    row->size += len;
     editorUpdateRow(row);
     e.dirty++;
+    journalRecord(JOURNAL_INSERT_STR, row - e.row, at, s, len);
+}
+
+void editorRowInsertChar(erow *row, int at, int c){
+    char ch = c;
+    editorRowInsertString(row, at, &ch, 1);
 }
 
 void editorRowAppendString(erow *row, char *s, size_t len){
-    row->chars = realloc(row->chars, row->size + len + 1);
-    memcpy(&row->chars[row->size], s, len);
-    row->size += len;
-    row->chars[row->size] = '\0';
-    editorUpdateRow(row);
-    e.dirty++;
+    editorRowInsertString(row, row->size, s, len);
 }
 
-void editorRowDelChar(erow *row, int at){
-    if(at < 0 || at >= row->size)
+void editorRowDelRange(erow *row, int at, int len){
+    //deletes len characters starting at at, anything past the end of the row is ignored
+    if(at < 0 || at >= row->size || len <= 0)
         return;
-    memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
-    row->size--;
+    if(len > row->size - at)
+        len = row->size - at;
+    memmove(&row->chars[at], &row->chars[at + len], row->size - at - len + 1);
+    row->size -= len;
     editorUpdateRow(row);
     e.dirty++;
+    journalRecord(JOURNAL_DEL_RANGE, row - e.row, at, NULL, len);
+}
+
+void editorRowDelChar(erow *row, int at){
+    editorRowDelRange(row, at, 1);
 }
 
 /*** editor operations ***/
@@ -414,9 +432,7 @@ void editorInsertNewLine(){
         erow *row = &e.row[e.cy];
         editorInsertRow(e.cy + 1, &row->chars[e.cx], row->size - e.cx);
         row = &e.row[e.cy];
-        row->size = e.cx;
-        row->chars[row->size] = '\0';
-        editorUpdateRow(row);
+        editorRowDelRange(row, e.cx, row->size - e.cx);
     }
     e.cy++;
     e.cx = 0;
@@ -443,8 +459,9 @@ void editorDelChar(){
 
 /*** file i/o ***/
 
-char *editorRowsToString(int *buflen){
-    int totlen = 0; 
+char *editorRowsToString(size_t *buflen){
+    //totlen is a size_t so that files larger than 2 GB don't overflow it
+    size_t totlen = 0; 
     int j;
     for(j = 0; j < e.numrows; j++)
         totlen += e.row[j].size + 1;
@@ -467,27 +484,106 @@ void editorOpen(char *filename){
     e.filename = strdup(filename);
 
     //opens the file passed as an argument
-    FILE *fp = fopen(filename, "r");
-    if(!fp)
-        die("fopen");
-
-    char *line = NULL;
-    size_t linecap = 0;
-    ssize_t linelen;
-
-    //reads a line and processes it in line
-    //linecap stores the size of the memory allocated
-    while((linelen = getline(&line, &linecap, fp)) != -1){
-        while(linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-            linelen --;
-        editorInsertRow(e.numrows, line, linelen);
-    }
-    free(line);
-    fclose(fp);
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1)
+        die("open");
+
+    //loading the file is not an edit, so none of these rows go to the swap file
+    journalSuspend(1);
+
+    struct stat st;
+    char *map = NULL;
+    e.compression = compressDetect(fd);
+    if(e.compression != COMPRESS_NONE && !compressSupported(e.compression)){
+        //without a decoder the buffer would be garbage, and saving it would destroy the file, so nothing is loaded
+        journalSuspend(0);
+        close(fd);
+        free(e.filename);
+        e.filename = NULL;
+        e.compression = COMPRESS_NONE;
+        editorSetStatusMessage("%s is zstd compressed, but this editor was built without zstd support", filename);
+        return;
+    }
+    if(e.compression == COMPRESS_NONE && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(e.compression != COMPRESS_NONE){
+        //compressed files are decoded as a stream straight into rows, never touching the disk uncompressed
+        int err = compressLoad(fd, e.compression);
+        if(err)
+            editorSetStatusMessage("%s could not be fully decompressed: %s", filename, strerror(err));
+    }
+    else if(map && map != MAP_FAILED && hexDetect((unsigned char *)map, st.st_size) && hexOpen(fd, st.st_size) == 0){
+        //binary files, and files whose first line never ends, are shown as hex paged from a mapping instead of being split into rows
+        munmap(map, st.st_size);
+        close(fd);
+        journalSuspend(0);
+        e.dirty = 0;
+        return;
+    }
+    else if(map && map != MAP_FAILED){
+        //the file is mapped and split into rows in place, without copying each line through a stdio buffer first
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        char *p = map, *end = map + st.st_size;
+        while(p < end){
+            char *nl = memchr(p, '\n', end - p);
+            char *next = nl ? nl + 1 : end;
+            char *lineend = nl ? nl : end;
+            while(lineend > p && (lineend[-1] == '\n' || lineend[-1] == '\r'))
+                lineend--;
+            editorInsertRow(e.numrows, p, lineend - p);
+            p = next;
+        }
+        munmap(map, st.st_size);
+    }
+    else{
+        //pipes and other files that can't be mapped are read line by line
+        FILE *fp = fdopen(dup(fd), "r");
+        if(!fp)
+            die("fdopen");
+
+        char *line = NULL;
+        size_t linecap = 0;
+        ssize_t linelen;
+
+        //reads a line and processes it in line
+        //linecap stores the size of the memory allocated
+        while((linelen = getline(&line, &linecap, fp)) != -1){
+            while(linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+                linelen --;
+            editorInsertRow(e.numrows, line, linelen);
+        }
+        free(line);
+        fclose(fp);
+    }
+    close(fd);
+    journalSuspend(0);
+    e.dirty = 0;
+    //what was just loaded is what later changes to the file are diffed against
+    reloadTrack(filename);
+
+    //offers to recover edits left in a swap file and starts journaling new ones
+    //recovered edits are applied first, so the table view and the search index start from the rows they end up with
+    journalOpenFile(filename);
+    tableOpenFile(filename);
+    trigramOpen(filename);
+}
+
+void editorSaved(size_t len){
     e.dirty = 0;
+    //everything is on disk now, so the swap file starts over against the saved version
+    journalStop(1);
+    journalStart(e.filename, 0);
+    reloadTrack(e.filename);
+    trigramSaved(e.filename);
+    editorSetStatusMessage("%zu bytes written to disk", len);
 }
 
 void editorSave(){
+    if(hexActive()){
+        //the hex view patches bytes in place and writes back only the pages it changed
+        hexSave();
+        return;
+    }
     if (e.filename == NULL){
         e.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL);
         if (e.filename == NULL){
@@ -495,20 +591,43 @@ void editorSave(){
             return;
         }
     }
+    //changes another program made to the file are merged in first, and only overwritten when the user says so
+    if (editorCheckDisk(1) == -1 && !editorConfirm("The file on disk has changes that are not in the buffer, overwrite them?")){
+        editorSetStatusMessage("Save aborted");
+        return;
+    }
+
+    size_t len; 
+
+    if (e.compression != COMPRESS_NONE){
+        //compressed files are written back in the format they were opened in, streamed through the compressor
+        if (compressSave(e.filename, e.compression, &len) == 0){
+            editorSaved(len);
+            return;
+        }
+        editorSetStatusMessage("Can not save the file due to I/O error: %s", strerror(errno));
+        return;
+    }
 
-    int len; 
     char *buf = editorRowsToString(&len);
 
     int fd = open(e.filename, O_RDWR | O_CREAT, 0644);
     if (fd != -1){
         if (ftruncate(fd, len) != -1){
         //in case of no error by ftruncate
-            if (write(fd, buf, len) == len){
+            //a single write is capped at about 2 GB, so keep writing until the whole buffer is on disk
+            size_t done = 0;
+            while (done < len){
+                ssize_t n = write(fd, buf + done, len - done);
+                if (n <= 0)
+                    break;
+                done += n;
+            }
+            if (done == len){
                 //if the write operation is successful
                 close(fd);
                 free(buf);
-                e.dirty = 0;
-                editorSetStatusMessage("%d bytes written to disk", len);
+                editorSaved(len);
                 return;
             }
         }
@@ -553,6 +672,13 @@ void editorFindCallback(char *query, int key){
             current = e.numrows - 1;
         else if (current == e.numrows)
             current = 0;
+        //rows the search index rules out are stepped over without being looked at
+        int skip = trigramSkip(query, current, direction);
+        if(skip > 0){
+            current += direction * (skip - 1);
+            i += skip - 1;
+            continue;
+        }
         erow *row = &e.row[current];
 
         char *match = strstr(row -> render, query);
@@ -585,23 +711,27 @@ void editorFind(){
 
 /*** append buffer ***/
 
-struct abuf{
-    char *b;
-    int len;
-};
-
-//represents an empty buffer 
-#define ABUF_INIT {NULL, 0}
+void abReserve(struct abuf *ab, int cap){
+    //makes room for at least cap bytes, doubling so that a buffer that keeps growing is reallocated only a few times
+    if(cap <= ab->cap)
+        return;
+    int newcap = ab->cap ? ab->cap : 1024;
+    while(newcap < cap)
+        newcap *= 2;
+    char *new = realloc(ab->b, newcap);
+    if(new == NULL)
+        return;
+    ab->b = new;
+    ab->cap = newcap;
+}
 
 void abAppend(struct abuf *ab, const char *s, int len){
     
     //requesting for sufficient memory
-    char *new = realloc(ab->b, ab->len+len);
-
-    if(new == NULL) return;
+    abReserve(ab, ab->len + len);
+    if(ab->cap < ab->len + len) return;
     //to copy the string s at the end of the current buffer
-    memcpy(&new[ab->len], s, len);
-    ab->b = new;
+    memcpy(&ab->b[ab->len], s, len);
     ab->len += len;
 }
 
@@ -615,17 +745,32 @@ void abFree(struct abuf *ab){
 void editorScroll(){
     //if the cursor has moved outside of visible window, we adjust e.rowoff value such that the cursor is in the visible window
     e.rx = 0;
+    if(hexActive()){
+        hexScroll();
+        return;
+    }
+
+    //the cursor never sits in a folded region, moving it into one opens it
+    while(e.cy < e.numrows && foldVisible(e.cy) != e.cy)
+        foldOpen(e.cy);
+    e.rowoff = foldVisible(e.rowoff);
 
     if(e.cy < e.numrows){
-        //set rx to proper value
-        e.rx = editorRowCxtoRx(&e.row[e.cy], e.cx);
+        //set rx to proper value, in the table view that is the column the field is drawn in
+        e.rx = tableActive() ? tableCxtoRx(&e.row[e.cy], e.cx) : editorRowCxtoRx(&e.row[e.cy], e.cx);
     }
 
+    //the table view keeps the header row on the top line, and the other rows scroll under it
+    int pinned = tableActive() && e.numrows > 1;
+    int rows = e.screenrows - pinned;
     if (e.cy < e.rowoff){ //checks if the cursor is above the visible window, if so, scroll to where the cursor is
         e.rowoff = e.cy;
     }
-    if(e.cy >= e.rowoff + e.screenrows){ //
-        e.rowoff = e.cy - e.screenrows + 1;
+    if(pinned && e.rowoff == 0)
+        e.rowoff = foldNextRow(0);
+    //rows are counted on screen, a folded region takes one row however many it hides
+    if(foldScreenRows(e.rowoff, e.cy) >= rows){
+        e.rowoff = foldRetreat(e.cy, rows - 1);
     }
     if(e.rx < e.coloff){
         e.coloff = e.rx;
@@ -635,14 +780,63 @@ void editorScroll(){
     }
 }
 
+void editorDrawMarkedRow(struct abuf *ab, erow *row, int *start, int *end, int marks){
+    //draws the visible part of a row with the render columns [start, end) of each mark in inverted colours
+    int x = e.coloff;
+    int right = e.coloff + e.screencols;
+    int i;
+    for(i = 0; i < marks && x < right; i++){
+        int s = start[i] < x ? x : start[i];
+        int en = end[i] > right ? right : end[i];
+        if(en <= s)
+            continue;
+        //plain text up to the mark
+        if(s > x && x < row->rsize)
+            abAppend(ab, &row->render[x], (s < row->rsize ? s : row->rsize) - x);
+        //padding up to a mark past the end of the row
+        for(x = x > row->rsize ? x : row->rsize; x < s; x++)
+            abAppend(ab, " ", 1);
+        abAppend(ab, "\x1b[7m", 4);
+        for(x = s; x < en; x++)
+            abAppend(ab, x < row->rsize ? &row->render[x] : " ", 1);
+        abAppend(ab, "\x1b[m", 3);
+    }
+    if(x < row->rsize && x < right)
+        abAppend(ab, &row->render[x], (right < row->rsize ? right : row->rsize) - x);
+}
+
+void editorDrawFoldMarker(struct abuf *ab, int rows, int room){
+    //a folded region is shown as its first row followed by a dimmed count of the rows it hides
+    char marker[32];
+    int len = snprintf(marker, sizeof(marker), " ... %d lines", rows);
+    if(len > room)
+        len = room;
+    if(len <= 0)
+        return;
+    abAppend(ab, "\x1b[2m", 4);
+    abAppend(ab, marker, len);
+    abAppend(ab, "\x1b[m", 3);
+}
+
 void editorDrawRows(struct abuf *ab){
     //to draw a column of tildes on the left side
     
-    int y;
+    int y = 0;
+    //to get the row of the file to be displayed at each position, we start at e.rowoff and step over folded regions
+    int filerow = e.rowoff;
+    if(hexActive()){
+        hexDrawRows(ab);
+        return;
+    }
+    if(tableActive() && e.numrows > 1){
+        //the header row of a table stays on the top line
+        tableDrawRow(ab, &e.row[0], 1);
+        abAppend(ab, "\x1b[K", 3);
+        abAppend(ab, "\r\n", 2);
+        y++;
+    }
     //draws tildes for each row, which is the number of rows on the screen
-    for(y = 0; y < e.screenrows ; y++){
-        //to get the row of the file to be displayed at each position, e.rowoff is added to the y value 
-        int filerow = y + e.rowoff;
+    for(; y < e.screenrows ; y++, filerow = foldNextRow(filerow)){
         if(filerow >= e.numrows){
         //checks whether the row currently being drawn is part of the text buffer or a row that comes after the end of the text buffer
             //welcome message is only presented if no file is provided as an argument while opening
@@ -674,8 +868,18 @@ void editorDrawRows(struct abuf *ab){
                 len = 0;
             if(len > e.screencols)
                 len = e.screencols;
+            int mstart[EDITOR_MAX_MARKS], mend[EDITOR_MAX_MARKS];
+            int marks = cursorsActive() && !tableActive() ? cursorsRowMarks(filerow, mstart, mend, EDITOR_MAX_MARKS) : 0;
+            if(tableActive())
+                len = tableDrawRow(ab, &e.row[filerow], 0);
+            else if(marks)
+                editorDrawMarkedRow(ab, &e.row[filerow], mstart, mend, marks);
+            else
                 //truncate the line if it is larger than what the screen can fit
-            abAppend(ab, &e.row[filerow].render[e.coloff], len);
+                abAppend(ab, &e.row[filerow].render[e.coloff], len);
+            int foldend;
+            if(!marks && foldIsHeader(filerow, &foldend))
+                editorDrawFoldMarker(ab, foldend - filerow, e.screencols - len);
         }
         //the K command erases the current line to the right of the cursor by deafult 0 value
         abAppend(ab, "\x1b[K", 3);
@@ -690,8 +894,19 @@ void editorDrawStatusBar(struct abuf *ab){
     
     char status[80], rstatus[80];
 
-    int len = snprintf(status, sizeof(status), "%.20s - %d lines %s", e.filename ? e.filename : "[No Name]", e.numrows, e.dirty ? "modified" : "");
+    int len;
+    if(profile_enabled){
+        //while profiling, the left side shows rolling p50/p99 of each stage in microseconds, allocations and bytes per frame
+        len = profileStatus(status, sizeof(status));
+    }
+    else{
+        len = snprintf(status, sizeof(status), "%.20s - %d lines %s", e.filename ? e.filename : "[No Name]", e.numrows, e.dirty ? "modified" : "");
+    }
     int rlen = snprintf(rstatus, sizeof(rstatus), "%d/%d", e.cy + 1, e.numrows); //prints the current line the cursor is on and the total numer of lines
+    if(hexActive() && !profile_enabled){
+        //the hex view counts bytes instead of lines
+        len = hexStatus(status, sizeof(status), rstatus, sizeof(rstatus), &rlen);
+    }
     if(len > e.screencols)
         len = e.screencols;
     abAppend(ab, status, len);
@@ -719,11 +934,62 @@ void editorDrawMessageBar(struct abuf *ab){
         abAppend(ab, e.statusmsg, msglen);
 }
 
+//when the last frame was written, frames are paced against it
+static struct timespec lastframe;
+
+int editorFrameDue(){
+    //keys that arrive together (a paste, or typing faster than the terminal draws) are all handled before the next frame, unless a frame interval has passed
+    struct pollfd pfd = {e.ifd, POLLIN, 0};
+    struct timespec now;
+    struct stat st;
+    //a headless driver queues one key at a time and expects a frame for each, unless it wrote several keys at once the way a paste arrives
+    if(e.headless){
+        if(fstat(e.ifd, &st) == -1 || lseek(e.ifd, 0, SEEK_CUR) >= st.st_size)
+            return 1;
+    }
+    else if(poll(&pfd, 1, 0) <= 0){
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - lastframe.tv_sec) * 1000 + (now.tv_nsec - lastframe.tv_nsec) / 1000000;
+    return ms >= FRAME_INTERVAL_MS;
+}
+
+static int editorWriteFrame(struct iovec *iov, int n){
+    //writes all of the frame, carrying on from where a short write stopped, returns -1 if the terminal could not take it
+    while(n > 0){
+        ssize_t w = writev(e.ofd, iov, n);
+        if(w == -1){
+            struct pollfd pfd = {e.ofd, POLLOUT, 0};
+            if(errno == EAGAIN)
+                poll(&pfd, 1, -1);
+            else if(errno != EINTR)
+                return -1;
+            continue;
+        }
+        while(n > 0 && (size_t)w >= iov->iov_len){
+            w -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if(n > 0){
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
 void editorRefreshScreen(){
 
+    profileBegin(PROF_SCROLL);
     editorScroll();
+    profileEnd(PROF_SCROLL);
 
-    struct abuf ab = ABUF_INIT;
+    //the same buffer is used for every frame, with room for a full screen of text and escape sequences from the start
+    static struct abuf ab = ABUF_INIT;
+    abReserve(&ab, (e.screenrows + 2) * (e.screencols + 16) * 2);
+    ab.len = 0;
 
     //hide the cursor when terminal is drawing to the screen
     abAppend(&ab, "\x1b[?25l", 6);
@@ -731,20 +997,42 @@ void editorRefreshScreen(){
     abAppend(&ab, "\x1b[H", 3);
 
     //draws a column of tildes on the left side of the screen
+    profileBegin(PROF_DRAW);
     editorDrawRows(&ab);
+    profileEnd(PROF_DRAW);
     editorDrawStatusBar(&ab);
     editorDrawMessageBar(&ab);
 
     //moves the cursor to position stored in e.cx and e.cy, 1 is added to convert 0 indexed values to values with index 1
     char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", e.cy - e.rowoff + 1, e.rx - e.coloff + 1);
+    //folded regions above the cursor take one screen row each, and a pinned table header takes the top one
+    int cursorrow = foldScreenRows(e.rowoff, e.cy) + 1;
+    if(tableActive() && e.numrows > 1)
+        cursorrow = e.cy == 0 ? 1 : cursorrow + 1;
+    int cursorcol = e.rx - e.coloff + 1;
+    if(hexActive())
+        hexCursorPosition(&cursorrow, &cursorcol);
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", cursorrow, cursorcol);
     abAppend(&ab, buf, strlen(buf));
 
     //show the cursor before the screen refreshes
     abAppend(&ab, "\x1b[?25h", 6);
 
-    write(STDOUT_FILENO, ab.b, ab.len);
-    abFree(&ab);
+    //terminals that support synchronized output show the frame only once all of it has arrived, so it never tears
+    static char syncbegin[] = "\x1b[?2026h", syncend[] = "\x1b[?2026l";
+    struct iovec iov[3] = {
+        {syncbegin, sizeof(syncbegin) - 1},
+        {ab.b, ab.len},
+        {syncend, sizeof(syncend) - 1}
+    };
+    size_t framelen = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+
+    profileBegin(PROF_WRITE);
+    if(editorWriteFrame(iov, 3) == 0)
+        e.lastframelen = framelen;
+    profileEnd(PROF_WRITE);
+    clock_gettime(CLOCK_MONOTONIC, &lastframe);
+    profileFrame(framelen);
 }
 
 void editorSetStatusMessage(const char *fmt, ...){
@@ -757,16 +1045,18 @@ void editorSetStatusMessage(const char *fmt, ...){
 
 /*** input ***/
 
-char *editorPrompt(char *prompt, void (*callback)(char *, int)){
+static char *editorPromptInput(char *prompt, void (*callback)(char *, int), int allow_empty){
     size_t bufsize = 128;
     char *buf = malloc(bufsize);
+    e.modal++;
 
     size_t buflen = 0;
     buf[0] = '\0';
 
     while(1){
         editorSetStatusMessage(prompt, buf);
-        editorRefreshScreen();
+        if(editorFrameDue())
+            editorRefreshScreen();
 
         int c = editorReadKey();
         if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE){
@@ -778,13 +1068,15 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)){
             if (callback)
                 callback(buf, c);
             free(buf);
+            e.modal--;
             return NULL;
         }
         else if (c == '\r'){
-            if (buflen != 0){
+            if (buflen != 0 || allow_empty){
                 editorSetStatusMessage("");
                 if (callback)
                     callback(buf, c);
+                e.modal--;
                 return buf;
             }
         }
@@ -801,6 +1093,26 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)){
     }
 }
 
+char *editorPrompt(char *prompt, void (*callback)(char *, int)){
+    return editorPromptInput(prompt, callback, 0);
+}
+
+char *editorPromptAllowEmpty(char *prompt, void (*callback)(char *, int)){
+    //like editorPrompt, but enter on an empty answer returns an empty string instead of being ignored
+    return editorPromptInput(prompt, callback, 1);
+}
+
+int editorConfirm(const char *question){
+    //asks a yes/no question in the message bar, anything but y counts as no
+    editorSetStatusMessage("%s (y/n)", question);
+    editorRefreshScreen();
+    e.modal++;
+    int c = editorReadKey();
+    e.modal--;
+    editorSetStatusMessage("");
+    return c == 'y' || c == 'Y';
+}
+
 void editorMoveCursor(int key){
     //updating the e.cx and e.cy values while checking the constraints that the cursor doesn't go out of bounds of the screen
 
@@ -812,26 +1124,27 @@ void editorMoveCursor(int key){
                 e.cx--;
             else if (e.cy > 0){
                 //pressing the left arrow key at the beginning of the line takes the cursor to the end of the previous line
-                e.cy--;
+                e.cy = foldPrevRow(e.cy);
                 e.cx = e.row[e.cy].size;
             }
             break;
         case ARROW_DOWN:
+            //a folded region is skipped in one step
             if (e.cy < e.numrows)
-                e.cy++;
+                e.cy = foldNextRow(e.cy);
             break;
         case ARROW_RIGHT:
             if (row && e.cx < row->size)
                 e.cx++;
             else if (row && e.cx == row->size){
                 //pressing the right arrow key at the end of a line takes the cursor to the beginning of the next line
-                e.cy++;
+                e.cy = foldNextRow(e.cy);
                 e.cx = 0;
             }
             break;
         case ARROW_UP:
             if (e.cy != 0)
-                e.cy--;
+                e.cy = foldPrevRow(e.cy);
             break;
     }
 
@@ -849,6 +1162,21 @@ void editorProcessKeypress(){
     static int quit_times = QUIT_TIMES;
 
     int c = editorReadKey();
+    profileBegin(PROF_PROCESS);
+
+    //with extra cursors or a column selection, editing and movement keys go to every cursor at once
+    //the hex view has keys of its own, and only passes on quitting, saving and the profiler
+    if(hexActive() && hexProcessKey(c)){
+        quit_times = QUIT_TIMES;
+        profileEnd(PROF_PROCESS);
+        return;
+    }
+
+    if(cursorsActive() && cursorsProcessKey(c)){
+        quit_times = QUIT_TIMES;
+        profileEnd(PROF_PROCESS);
+        return;
+    }
 
     switch(c){
 
@@ -862,10 +1190,13 @@ void editorProcessKeypress(){
             if(e.dirty && quit_times > 0){
                 editorSetStatusMessage("Warning! File has unsaved changes. Press ctrl-q %d more times to quit. ", quit_times);
                 quit_times--;
+                profileEnd(PROF_PROCESS);
                 return;
             }
             write(STDOUT_FILENO, "\x1b[2J", 4);
             write(STDOUT_FILENO, "\x1b[H", 3);
+            //quitting on purpose throws the unsaved changes away, swap file included
+            journalStop(1);
             exit(0);
             break;
         
@@ -877,6 +1208,36 @@ void editorProcessKeypress(){
             editorFind();
             break;
 
+        case CTRL_KEY('r'):
+            editorReplace();
+            break;
+
+        case CTRL_KEY('e'):
+            editorFilter();
+            break;
+
+        case CTRL_KEY('k'):
+            editorToggleFold();
+            break;
+
+        case CTRL_KEY('o'):
+            editorToggleAllFolds();
+            break;
+
+        case CTRL_KEY('t'):
+            editorToggleTable();
+            break;
+
+        case CTRL_KEY('z'):
+            if(!editorUndo())
+                editorSetStatusMessage("Nothing to undo");
+            break;
+
+        case CTRL_KEY('p'):
+            profileToggle();
+            editorSetStatusMessage(profile_enabled ? "Profiler on, ctrl-p to turn it off" : "Profiler off");
+            break;
+
         case HOME_KEY:
             e.cx = 0;
             break;
@@ -902,9 +1263,8 @@ void editorProcessKeypress(){
                 e.cy = e.rowoff;
             }
             else if(c == PAGE_DOWN){
-                e.cy = e.rowoff + e.screenrows - 1;
-                if(e.cy > e.numrows)
-                    e.cy = e.numrows;
+                //the last row on screen, counting a folded region as one row
+                e.cy = foldAdvance(e.rowoff, e.screenrows - 1);
             }
             int times = e.screenrows;
             while (times--)
@@ -919,6 +1279,17 @@ void editorProcessKeypress(){
             editorMoveCursor(c);
             break;
 
+        case CTRL_KEY('n'):
+            cursorsAddBelow();
+            break;
+
+        case SHIFT_ARROW_LEFT:
+        case SHIFT_ARROW_RIGHT:
+        case SHIFT_ARROW_DOWN:
+        case SHIFT_ARROW_UP:
+            cursorsExtendSelection(c);
+            break;
+
         case CTRL_KEY('l'):
         case '\x1b':
             break;
@@ -929,11 +1300,27 @@ void editorProcessKeypress(){
             break;
     }
     quit_times = QUIT_TIMES;
+    profileEnd(PROF_PROCESS);
 }
 
 /*** init ***/
 
-void initEditor(){
+void editorReset(){
+    //frees whatever buffer is loaded and puts the editor back in its initial state, the screen size is left to the caller
+    int j;
+    journalStop(1);
+    cursorsClear();
+    replaceForget();
+    reloadForget();
+    foldClear();
+    tableClear();
+    trigramForget();
+    hexClose();
+    for(j = 0; j < e.numrows; j++)
+        editorFreeRow(&e.row[j]);
+    free(e.row);
+    free(e.filename);
+
     //initialize the cursor values, such that it is at the top left corner of the screen
     e.cx = 0;
     e.cy = 0;
@@ -947,25 +1334,19 @@ void initEditor(){
     e.filename = NULL;
     e.statusmsg[0] = '\0';
     e.statusmsg_time = 0;
+    e.ifd = STDIN_FILENO;
+    e.ofd = STDOUT_FILENO;
+    e.headless = 0;
+    e.keysource = NULL;
+    e.lastframelen = 0;
+    e.compression = COMPRESS_NONE;
+    e.modal = 0;
+}
+
+void initEditor(){
+    editorReset();
     //we get the window size and store them successfully in editorConfig e
     if(getWindowSize(&e.screenrows, &e.screencols) == -1)
         die("getWindowSize");
     e.screenrows -= 2; //the last two lines shouldn't be scrolled
 }
-
-int main(int argc, char *argv[]){
-
-    enableRawMode();
-    initEditor();
-    if(argc >= 2){
-        editorOpen(argv[1]);
-    }
-
-    editorSetStatusMessage("HELP: Ctrl - S = save | Ctrl - Q = quit | Ctrl - F = find");
-
-    while(1){
-        editorRefreshScreen();
-        editorProcessKeypress();
-    }
-    return 0;
-}
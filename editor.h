@@ -0,0 +1,352 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include<stddef.h>
+#include<stdint.h>
+#include<sys/types.h>
+#include<termios.h>
+#include<time.h>
+
+/*** defines ***/
+
+//CTRL_KEY macro bitwise ANDs a character with the value 00011111 in binary, this mirrors the function of a ctrl key in the terminal, stripping away bits 5 and 6 from whatever key you press in combination with ctrl
+#define CTRL_KEY(k) ((k) & 0x1f)
+
+#define EDITOR_VERSION "0.0.1"
+#define TAB_STOP 8
+#define QUIT_TIMES 3
+//while keys keep arriving, the screen is redrawn at most once per this many milliseconds
+#define FRAME_INTERVAL_MS 16
+//most highlighted spans (extra cursors) drawn on a single row
+#define EDITOR_MAX_MARKS 64
+
+enum editorKey{
+    //the rest would be set to incrementing values automatically
+    BACKSPACE = 127,
+    ARROW_LEFT = 1000,
+    ARROW_RIGHT,
+    ARROW_DOWN,
+    ARROW_UP,
+    DEL_KEY,
+    HOME_KEY,
+    END_KEY,
+    PAGE_UP,
+    PAGE_DOWN,
+    SHIFT_ARROW_LEFT,
+    SHIFT_ARROW_RIGHT,
+    SHIFT_ARROW_DOWN,
+    SHIFT_ARROW_UP
+};
+
+/*** data ***/
+
+typedef struct erow{
+    //struct to store a row of data
+
+    int size;
+    int rsize;
+    char *chars;
+    char *render;
+    //where each field starts in the table view, filled in the first time the row is drawn as a table and dropped when it changes
+    int *fields;
+    int numfields;
+    //block of rows the search index files this row under, -1 until the row is part of the buffer
+    int block;
+}erow; //editor row
+
+typedef struct cursor{
+    //an extra cursor, in the same coordinates as e.cx and e.cy
+    int cx, cy;
+}cursor;
+
+struct editorConfig{
+
+    //current position of the cursor
+    int cx, cy;
+    int rx;
+    //rowoff and coloff keeps track of the row and the column of the file the user is currently scrolled to
+    int rowoff;
+    int coloff;
+    //for the number of rows and columns on screen
+    int screenrows;
+    int screencols;
+
+    int numrows;
+    erow *row;
+
+    //extra cursors besides (cx, cy), sorted by row and then column
+    cursor *cursors;
+    int numcursors;
+    //corner where a column selection started, the opposite corner is (selcol, cy), sely is -1 without a selection
+    //cx stays within the row while selcol keeps the rectangle's column on rows shorter than it
+    int selx, sely, selcol;
+
+    int dirty;
+    char *filename;
+    char statusmsg[80];
+    time_t statusmsg_time;
+    //stores the configuration of the original terminal
+    struct termios orig_termios;
+
+    //keys are read from ifd and frames are written to ofd, these are the terminal unless a headless driver replaces them
+    int ifd;
+    int ofd;
+    //when set, the editor is not attached to a terminal and keysource is called whenever ifd runs dry
+    int headless;
+    //returns 0 once there are no more scripted keys to queue on ifd
+    int (*keysource)(void);
+    //number of bytes the last editorRefreshScreen wrote to ofd
+    size_t lastframelen;
+
+    //format the file was compressed with when it was opened, editorSave writes it back the same way
+    int compression;
+
+    //non-zero while a prompt or a question waits for an answer, background work that moves rows around waits until then
+    int modal;
+};
+
+extern struct editorConfig e;
+
+/*** append buffer ***/
+
+struct abuf{
+    char *b;
+    int len;
+    //bytes allocated for b, which grows by doubling
+    int cap;
+};
+
+//represents an empty buffer
+#define ABUF_INIT {NULL, 0, 0}
+
+void abReserve(struct abuf *ab, int cap);
+void abAppend(struct abuf *ab, const char *s, int len);
+void abFree(struct abuf *ab);
+
+/*** profiler ***/
+
+//stages of the main loop that are timed, followed by the per frame counters
+enum profileMetricId{
+    PROF_READ,
+    PROF_PROCESS,
+    PROF_SCROLL,
+    PROF_DRAW,
+    PROF_WRITE,
+    PROF_IDLE,
+    PROF_STAGES,
+    PROF_ALLOCS = PROF_STAGES,
+    PROF_ALLOC_BYTES,
+    PROF_FRAME_BYTES,
+    PROFILE_METRICS
+};
+
+#define PROFILE_WINDOW 256
+#define PROFILE_BUCKETS 96
+
+extern int profile_enabled;
+
+void profileInit();
+void profileToggle();
+void profileBegin(int stage);
+void profileEnd(int stage);
+void profileFrame(size_t bytes);
+void *profileMalloc(size_t size);
+void *profileCalloc(size_t n, size_t size);
+void *profileRealloc(void *ptr, size_t size);
+char *profileStrdup(const char *s);
+char *profileStrndup(const char *s, size_t n);
+int profileStatus(char *buf, size_t len);
+void profileDump(const char *path);
+void profileDumpAtExit();
+
+/*** journal ***/
+
+//row operations recorded in the swap file, every other edit is built out of these
+enum journalOpType{
+    JOURNAL_INSERT_ROW = 1,
+    JOURNAL_DEL_ROW,
+    JOURNAL_INSERT_STR,
+    JOURNAL_DEL_RANGE
+};
+
+char *journalPath(const char *filename);
+void journalInstallSignals();
+void journalStart(const char *filename, int keep);
+void journalStop(int remove);
+void journalSuspend(int on);
+void journalRecord(int type, int row, int pos, const char *s, size_t len);
+void journalFlush(int sync);
+void journalIdle();
+int journalCheck(const char *filename);
+int journalReplay(const char *filename);
+void journalOpenFile(const char *filename);
+
+/*** compression ***/
+
+enum compressType{
+    COMPRESS_NONE = 0,
+    COMPRESS_GZIP,
+    COMPRESS_ZSTD
+};
+
+int compressDetect(int fd);
+int compressSupported(int type);
+int compressLoad(int fd, int type);
+int compressSave(const char *filename, int type, size_t *written);
+
+/*** multiple cursors ***/
+
+int cursorsActive();
+void cursorsClear();
+void cursorsAddBelow();
+void cursorsExtendSelection(int key);
+int cursorsProcessKey(int c);
+void cursorsRowsInserted(int at, int n);
+void cursorsRowsDeleted(int at, int n);
+int cursorsRowMarks(int filerow, int *start, int *end, int max);
+
+/*** replace ***/
+
+long editorReplaceAll(const char *query, const char *with, int *rows);
+int editorUndo();
+void replaceForget();
+void editorReplace();
+
+/*** reload ***/
+
+void reloadTrack(const char *filename);
+void reloadForget();
+int reloadStamp(off_t *size, struct timespec *mtime, uint64_t *hash);
+int editorReload();
+int editorCheckDisk(int force);
+
+/*** filter ***/
+
+int editorFilterRows(int at, int n, const char *command);
+void editorFilter();
+
+/*** folding ***/
+
+int foldCount();
+int foldIsHeader(int row, int *end);
+int foldVisible(int row);
+int foldNextRow(int row);
+int foldPrevRow(int row);
+int foldScreenRows(int from, int to);
+int foldAdvance(int row, int n);
+int foldRetreat(int row, int n);
+void foldClose(int start, int end);
+int foldOpen(int row);
+void foldClear();
+void foldRowsInserted(int at, int n);
+void foldRowsDeleted(int at, int n);
+int foldRegion(int at, int *end);
+void editorToggleFold();
+void editorToggleAllFolds();
+
+/*** table view ***/
+
+int tableActive();
+void tableRowChanged(erow *row);
+void tableRowsInserted(int at, int n);
+void tableRowsDeleted(int at, int n);
+void tableIdle();
+int tableCxtoRx(erow *row, int cx);
+int tableDrawRow(struct abuf *ab, erow *row, int header);
+void tableClear();
+void tableOpenFile(const char *filename);
+void editorToggleTable();
+
+/*** search index ***/
+
+char *trigramPath(const char *filename);
+void trigramForget();
+void trigramOpen(const char *filename);
+void trigramSaved(const char *filename);
+void trigramRowChanged(erow *row);
+void trigramRowsInserted(int at, int n);
+void trigramIdle();
+int trigramSkip(const char *query, int row, int direction);
+
+/*** hex view ***/
+
+int hexActive();
+int hexDetect(const unsigned char *map, size_t size);
+int hexOpen(int fd, size_t size);
+void hexClose();
+void hexScroll();
+void hexDrawRows(struct abuf *ab);
+void hexCursorPosition(int *row, int *col);
+int hexStatus(char *status, size_t len, char *rstatus, size_t rlen, int *rstatuslen);
+void hexSave();
+int hexProcessKey(int c);
+
+/*** prototypes ***/
+
+//terminal
+void die(const char *s);
+void disableRawMode();
+void enableRawMode();
+int editorReadKey();
+void editorIdle();
+int getWindowSize(int *rows, int *columns);
+
+//row operations
+int editorRowCxtoRx(erow *row, int cx);
+int editorRowRxtoCx(erow *row, int rx);
+void editorUpdateRow(erow *row);
+void editorRowsInserted(int at, int n);
+void editorRowsDeleted(int at, int n);
+void editorInsertRow(int at, char *s, size_t len);
+void editorFreeRow(erow *row);
+void editorDelRow(int at);
+void editorRowInsertString(erow *row, int at, char *s, size_t len);
+void editorRowInsertChar(erow *row, int at, int c);
+void editorRowAppendString(erow *row, char *s, size_t len);
+void editorRowDelRange(erow *row, int at, int len);
+void editorRowDelChar(erow *row, int at);
+
+//editor operations
+void editorInsertChar(int c);
+void editorInsertNewLine();
+void editorDelChar();
+
+//file i/o
+char *editorRowsToString(size_t *buflen);
+void editorOpen(char *filename);
+void editorSaved(size_t len);
+void editorSave();
+
+//find
+void editorFindCallback(char *query, int key);
+void editorFind();
+
+//output
+void editorScroll();
+void editorDrawMarkedRow(struct abuf *ab, erow *row, int *start, int *end, int marks);
+void editorDrawFoldMarker(struct abuf *ab, int rows, int room);
+void editorDrawRows(struct abuf *ab);
+void editorDrawStatusBar(struct abuf *ab);
+void editorDrawMessageBar(struct abuf *ab);
+int editorFrameDue();
+void editorRefreshScreen();
+void editorSetStatusMessage(const char *fmt, ...);
+
+//input
+char *editorPrompt(char *prompt, void (*callback)(char *, int));
+char *editorPromptAllowEmpty(char *prompt, void (*callback)(char *, int));
+int editorConfirm(const char *question);
+void editorMoveCursor(int key);
+void editorProcessKeypress();
+
+//init
+void editorReset();
+void initEditor();
+
+#endif
@@ -0,0 +1,393 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<errno.h>
+#include<fcntl.h>
+#include<poll.h>
+#include<signal.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/wait.h>
+#include<unistd.h>
+
+#include "alloc.h"
+
+/*** data ***/
+
+//size of the buffers between the editor and the command in each direction
+#define FILTER_CHUNK (256 * 1024)
+//pipe capacity asked for on Linux, the default 64 KB makes the editor and the command take turns too often
+#define FILTER_PIPE_SIZE (1024 * 1024)
+//how often the status bar shows how far the command has got, in milliseconds
+#define FILTER_PROGRESS_MS 100
+
+//rows [row, end) go to the command's stdin, one at a time through a small buffer so the region is never copied as a whole
+struct filterInput{
+    int row, end;
+    //bytes of the current row already buffered, size means only its newline is left
+    int pos;
+    char buf[FILTER_CHUNK];
+    size_t len, off;
+    size_t total;
+};
+
+//the command's stdout becomes rows as it arrives, a line split across two reads waits in partial
+struct filterOutput{
+    erow *rows;
+    int numrows, cap;
+    char *partial;
+    size_t partlen, partcap;
+    size_t total;
+};
+
+/*** filter ***/
+
+static void filterFill(struct filterInput *in){
+    //tops the buffer up with the next rows, each one followed by a newline
+    if(in->off == in->len)
+        in->off = in->len = 0;
+    while(in->row < in->end && in->len < FILTER_CHUNK){
+        erow *row = &e.row[in->row];
+        if(in->pos < row->size){
+            size_t n = row->size - in->pos;
+            if(n > FILTER_CHUNK - in->len)
+                n = FILTER_CHUNK - in->len;
+            memcpy(in->buf + in->len, row->chars + in->pos, n);
+            in->len += n;
+            in->pos += n;
+            continue;
+        }
+        in->buf[in->len++] = '\n';
+        in->row++;
+        in->pos = 0;
+    }
+}
+
+static void filterAddRow(struct filterOutput *out, const char *s, size_t len){
+    while(len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r'))
+        len--;
+    if(out->numrows == out->cap){
+        out->cap = out->cap ? out->cap * 2 : 1024;
+        out->rows = realloc(out->rows, sizeof(erow) * out->cap);
+    }
+    erow *row = &out->rows[out->numrows++];
+    row->size = len;
+    row->chars = malloc(len + 1);
+    memcpy(row->chars, s, len);
+    row->chars[len] = '\0';
+    row->rsize = 0;
+    row->render = NULL;
+    row->fields = NULL;
+    row->numfields = 0;
+    row->block = -1;
+    editorUpdateRow(row);
+}
+
+static void filterOutputChunk(struct filterOutput *out, const char *buf, size_t len){
+    //whole lines become rows straight from the read buffer, only the unfinished last one is copied aside
+    const char *p = buf, *end = buf + len;
+    out->total += len;
+    while(p < end){
+        const char *nl = memchr(p, '\n', end - p);
+        if(!nl){
+            size_t n = end - p;
+            if(out->partlen + n > out->partcap){
+                out->partcap = (out->partlen + n) * 2;
+                out->partial = realloc(out->partial, out->partcap);
+            }
+            memcpy(out->partial + out->partlen, p, n);
+            out->partlen += n;
+            break;
+        }
+        if(out->partlen){
+            size_t n = nl - p;
+            if(out->partlen + n > out->partcap){
+                out->partcap = (out->partlen + n) * 2;
+                out->partial = realloc(out->partial, out->partcap);
+            }
+            memcpy(out->partial + out->partlen, p, n);
+            filterAddRow(out, out->partial, out->partlen + n);
+            out->partlen = 0;
+        }
+        else
+            filterAddRow(out, p, nl - p);
+        p = nl + 1;
+    }
+}
+
+static void filterFreeOutput(struct filterOutput *out){
+    int i;
+    for(i = 0; i < out->numrows; i++)
+        editorFreeRow(&out->rows[i]);
+    free(out->rows);
+    free(out->partial);
+}
+
+static void filterReplaceRows(int at, int n, struct filterOutput *out){
+    //rows [at, at + n) give way to the command's output with a single move of the rows after them
+    int i;
+    int m = out->numrows;
+    for(i = at; i < at + n; i++)
+        editorFreeRow(&e.row[i]);
+    if(m > n)
+        e.row = realloc(e.row, sizeof(erow) * (e.numrows + m - n));
+    memmove(&e.row[at + m], &e.row[at + n], sizeof(erow) * (e.numrows - at - n));
+    if(m)
+        memcpy(&e.row[at], out->rows, sizeof(erow) * m);
+    e.numrows += m - n;
+    e.dirty++;
+
+    //the swap file sees the same thing as row deletes and inserts
+    for(i = 0; i < n; i++)
+        journalRecord(JOURNAL_DEL_ROW, at, 0, NULL, 0);
+    for(i = 0; i < m; i++)
+        journalRecord(JOURNAL_INSERT_ROW, at + i, 0, e.row[at + i].chars, e.row[at + i].size);
+    if(n)
+        editorRowsDeleted(at, n);
+    if(m)
+        editorRowsInserted(at, m);
+    replaceForget();
+
+    //the rows now belong to the buffer
+    free(out->rows);
+    out->rows = NULL;
+    out->numrows = 0;
+}
+
+static int filterCancelled(){
+    //ctrl + c or escape typed while the command runs stops it, other keys are dropped
+    struct pollfd pfd = {e.ifd, POLLIN, 0};
+    char c;
+    if(e.headless || poll(&pfd, 1, 0) != 1 || read(e.ifd, &c, 1) != 1)
+        return 0;
+    return c == CTRL_KEY('c') || c == '\x1b';
+}
+
+static double filterNowMs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int editorFilterRows(int at, int n, const char *command){
+    //pipes rows [at, at + n) through command and replaces them with what it prints
+    //returns 0 when the rows were replaced, 1 when the user cancelled and -1 when the command failed
+    int in[2], out[2], err[2];
+    if(pipe(in) == -1)
+        return -1;
+    if(pipe(out) == -1){
+        close(in[0]);
+        close(in[1]);
+        return -1;
+    }
+    if(pipe(err) == -1){
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+    pid_t pid = fork();
+    if(pid == 0){
+        //a group of its own lets cancelling stop everything the shell started, not just the shell
+        setpgid(0, 0);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        close(err[0]);
+        close(err[1]);
+        execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+        _exit(127);
+    }
+    if(pid > 0)
+        setpgid(pid, pid);
+    close(in[0]);
+    close(out[1]);
+    close(err[1]);
+    if(pid == -1){
+        close(in[1]);
+        close(out[0]);
+        close(err[0]);
+        return -1;
+    }
+
+    //a command that stops reading early must not kill the editor with SIGPIPE
+    struct sigaction ign, old;
+    memset(&ign, 0, sizeof(ign));
+    ign.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ign, &old);
+
+    //both directions are non-blocking, so a command that prints while it reads never waits on the editor and the other way round
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+    //bigger pipes mean fewer trips between the editor and the command, where the kernel allows it
+    fcntl(in[1], F_SETPIPE_SZ, FILTER_PIPE_SIZE);
+    fcntl(out[0], F_SETPIPE_SZ, FILTER_PIPE_SIZE);
+#endif
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+    fcntl(err[0], F_SETFL, O_NONBLOCK);
+
+    struct filterInput *input = malloc(sizeof(struct filterInput));
+    struct filterOutput output = {0};
+    char *buf = malloc(FILTER_CHUNK);
+    char errmsg[64] = "";
+    size_t errlen = 0;
+    input->row = at;
+    input->end = at + n;
+    input->pos = 0;
+    input->len = input->off = 0;
+    input->total = 0;
+    int fdin = in[1], fdout = out[0], fderr = err[0];
+    int cancelled = 0;
+    double lastprogress = filterNowMs();
+
+    while(fdout != -1 || fderr != -1){
+        struct pollfd fds[3];
+        int nfds = 0, iin = -1, iout = -1, ierr = -1;
+        if(fdin != -1){
+            filterFill(input);
+            if(input->off == input->len){
+                //everything has been written, closing stdin lets the command see the end of its input
+                close(fdin);
+                fdin = -1;
+            }
+            else{
+                iin = nfds;
+                fds[nfds++] = (struct pollfd){fdin, POLLOUT, 0};
+            }
+        }
+        if(fdout != -1){
+            iout = nfds;
+            fds[nfds++] = (struct pollfd){fdout, POLLIN, 0};
+        }
+        if(fderr != -1){
+            ierr = nfds;
+            fds[nfds++] = (struct pollfd){fderr, POLLIN, 0};
+        }
+        if(poll(fds, nfds, FILTER_PROGRESS_MS) == -1 && errno != EINTR)
+            break;
+
+        if(iin != -1 && fds[iin].revents){
+            ssize_t w = write(fdin, input->buf + input->off, input->len - input->off);
+            if(w > 0){
+                input->off += w;
+                input->total += w;
+            }
+            else if(w == -1 && errno != EAGAIN && errno != EINTR){
+                //the command closed its stdin, the rest of the rows are not for it
+                close(fdin);
+                fdin = -1;
+            }
+        }
+        if(iout != -1 && fds[iout].revents){
+            ssize_t r = read(fdout, buf, FILTER_CHUNK);
+            if(r > 0)
+                filterOutputChunk(&output, buf, r);
+            else if(r == 0 || (errno != EAGAIN && errno != EINTR)){
+                close(fdout);
+                fdout = -1;
+            }
+        }
+        if(ierr != -1 && fds[ierr].revents){
+            ssize_t r = read(fderr, buf, FILTER_CHUNK);
+            if(r > 0 && errlen < sizeof(errmsg) - 1){
+                //the start of stderr is kept for the status bar, up to its first line
+                size_t keep = sizeof(errmsg) - 1 - errlen;
+                if((size_t)r < keep)
+                    keep = r;
+                memcpy(errmsg + errlen, buf, keep);
+                errlen += keep;
+                errmsg[errlen] = '\0';
+                errmsg[strcspn(errmsg, "\r\n")] = '\0';
+            }
+            else if(r == 0 || (r == -1 && errno != EAGAIN && errno != EINTR)){
+                close(fderr);
+                fderr = -1;
+            }
+        }
+
+        double now = filterNowMs();
+        if(now - lastprogress >= FILTER_PROGRESS_MS){
+            lastprogress = now;
+            if(filterCancelled()){
+                cancelled = 1;
+                kill(-pid, SIGTERM);
+                break;
+            }
+            editorSetStatusMessage("Filtering: %zu KB in, %zu KB out, ctrl-c to cancel", input->total / 1024, output.total / 1024);
+            editorRefreshScreen();
+        }
+    }
+    if(fdin != -1)
+        close(fdin);
+    if(fdout != -1)
+        close(fdout);
+    if(fderr != -1)
+        close(fderr);
+    free(buf);
+    int status = 0;
+    if(cancelled){
+        //a command that ignores SIGTERM gets a second to go before it is killed
+        int waited;
+        for(waited = 0; waited < 10 && waitpid(pid, &status, WNOHANG) == 0; waited++)
+            usleep(100000);
+        if(waited == 10)
+            kill(-pid, SIGKILL);
+    }
+    while(waitpid(pid, &status, 0) == -1 && errno == EINTR)
+        ;
+    sigaction(SIGPIPE, &old, NULL);
+
+    int ret;
+    if(cancelled){
+        editorSetStatusMessage("Filter cancelled, the rows are unchanged");
+        ret = 1;
+    }
+    else if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        if(WIFEXITED(status))
+            editorSetStatusMessage("%s exited with %d: %s", command, WEXITSTATUS(status), errmsg);
+        else
+            editorSetStatusMessage("%s was killed by signal %d", command, WTERMSIG(status));
+        ret = -1;
+    }
+    else{
+        //output without a final newline still ends with a row
+        if(output.partlen)
+            filterAddRow(&output, output.partial, output.partlen);
+        int m = output.numrows;
+        filterReplaceRows(at, n, &output);
+        editorSetStatusMessage("Filtered %d rows into %d through %s", n, m, command);
+        ret = 0;
+    }
+    filterFreeOutput(&output);
+    free(input);
+    return ret;
+}
+
+void editorFilter(){
+    //the rows of the column selection, or else the whole file, go through a shell command
+    int at = 0, n = e.numrows;
+    if(e.sely != -1){
+        at = e.sely < e.cy ? e.sely : e.cy;
+        n = (e.sely < e.cy ? e.cy : e.sely) - at + 1;
+        if(at + n > e.numrows)
+            n = e.numrows - at;
+    }
+    char prompt[80];
+    snprintf(prompt, sizeof(prompt), "Filter rows %d-%d through: %%s (ESC to cancel)", at + 1, at + n);
+    char *command = editorPrompt(prompt, NULL);
+    if(!command)
+        return;
+    cursorsClear();
+    if(editorFilterRows(at, n, command) == 0){
+        e.cy = at;
+        e.cx = 0;
+    }
+    free(command);
+}
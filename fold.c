@@ -0,0 +1,337 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<stdlib.h>
+#include<string.h>
+
+#include "alloc.h"
+
+/*** data ***/
+
+//a closed fold keeps row start on screen and hides rows start + 1 to end
+struct fold{
+    int start;
+    int end;
+};
+
+//the fold index: closed folds sorted by start and never overlapping, with hidden[i] the number of rows hidden by the folds before i
+static struct fold *folds = NULL;
+static int *hidden = NULL;
+static int numfolds = 0;
+
+/*** fold index ***/
+
+static void foldReindex(){
+    //the running count of hidden rows, rebuilt after the folds change, which costs the number of folds and not the number of rows
+    int i;
+    hidden = realloc(hidden, sizeof(int) * (numfolds + 1));
+    hidden[0] = 0;
+    for(i = 0; i < numfolds; i++)
+        hidden[i + 1] = hidden[i] + folds[i].end - folds[i].start;
+}
+
+static int foldFind(int row){
+    //index of the last fold starting at or before row, -1 if there is none
+    int lo = 0, hi = numfolds - 1, found = -1;
+    while(lo <= hi){
+        int mid = (lo + hi) / 2;
+        if(folds[mid].start <= row){
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    return found;
+}
+
+static void foldRemove(int i){
+    memmove(&folds[i], &folds[i + 1], sizeof(struct fold) * (numfolds - i - 1));
+    numfolds--;
+}
+
+int foldCount(){
+    return numfolds;
+}
+
+int foldIsHeader(int row, int *end){
+    //whether row is the visible first row of a closed fold, end gets the last row the fold hides
+    int i = foldFind(row);
+    if(i == -1 || folds[i].start != row)
+        return 0;
+    if(end)
+        *end = folds[i].end;
+    return 1;
+}
+
+int foldVisible(int row){
+    //row itself if it is on screen, otherwise the header of the fold hiding it
+    int i = foldFind(row);
+    if(i != -1 && row > folds[i].start && row <= folds[i].end)
+        return folds[i].start;
+    return row;
+}
+
+int foldNextRow(int row){
+    //the visible row after row, skipping a closed fold in one step
+    int end;
+    if(foldIsHeader(row, &end))
+        return end + 1;
+    return row + 1;
+}
+
+int foldPrevRow(int row){
+    //the visible row before row
+    if(row <= 0)
+        return 0;
+    return foldVisible(row - 1);
+}
+
+static int foldHiddenBefore(int row){
+    //number of hidden rows above row
+    int i = foldFind(row - 1);
+    if(i == -1)
+        return 0;
+    int end = folds[i].end < row - 1 ? folds[i].end : row - 1;
+    return hidden[i] + end - folds[i].start;
+}
+
+int foldScreenRows(int from, int to){
+    //number of visible rows in [from, to)
+    if(to <= from)
+        return 0;
+    return (to - from) - (foldHiddenBefore(to) - foldHiddenBefore(from));
+}
+
+int foldAdvance(int row, int n){
+    //the visible row n screen rows below row, or the line past the end of the file
+    while(n-- > 0 && row < e.numrows)
+        row = foldNextRow(row);
+    return row > e.numrows ? e.numrows : row;
+}
+
+int foldRetreat(int row, int n){
+    //the visible row n screen rows above row
+    while(n-- > 0 && row > 0)
+        row = foldPrevRow(row);
+    return row;
+}
+
+void foldClose(int start, int end){
+    //hides rows start + 1 to end, folds already inside the range are absorbed by it
+    if(end <= start)
+        return;
+    int i = foldFind(start);
+    if(i != -1 && folds[i].end >= start){
+        //start is already hidden by (or heads) a fold, which grows to cover the new one instead
+        start = folds[i].start;
+        if(folds[i].end > end)
+            end = folds[i].end;
+        foldRemove(i);
+        i--;
+    }
+    i++;
+    while(i < numfolds && folds[i].start <= end){
+        if(folds[i].end > end)
+            end = folds[i].end;
+        foldRemove(i);
+    }
+    folds = realloc(folds, sizeof(struct fold) * (numfolds + 1));
+    memmove(&folds[i + 1], &folds[i], sizeof(struct fold) * (numfolds - i));
+    folds[i].start = start;
+    folds[i].end = end;
+    numfolds++;
+    foldReindex();
+}
+
+int foldOpen(int row){
+    //opens the fold headed by or hiding row, returns 0 if there was none
+    int i = foldFind(row);
+    if(i == -1 || row > folds[i].end)
+        return 0;
+    foldRemove(i);
+    foldReindex();
+    return 1;
+}
+
+void foldClear(){
+    free(folds);
+    free(hidden);
+    folds = NULL;
+    hidden = NULL;
+    numfolds = 0;
+}
+
+void foldRowsInserted(int at, int n){
+    //rows inserted inside a fold stay hidden with it, the folds below move down
+    int i, changed = 0;
+    for(i = numfolds - 1; i >= 0 && folds[i].end >= at; i--){
+        if(folds[i].start >= at)
+            folds[i].start += n;
+        folds[i].end += n;
+        changed = 1;
+    }
+    if(changed)
+        foldReindex();
+}
+
+void foldRowsDeleted(int at, int n){
+    //a fold whose header is deleted opens, one that loses hidden rows shrinks, the folds below move up
+    int i, changed = 0;
+    for(i = numfolds - 1; i >= 0 && folds[i].end >= at; i--){
+        struct fold *f = &folds[i];
+        changed = 1;
+        if(f->start >= at && f->start < at + n){
+            foldRemove(i);
+            continue;
+        }
+        if(f->start >= at + n){
+            f->start -= n;
+            f->end -= n;
+            continue;
+        }
+        //the deleted rows overlap the hidden part of this fold
+        int gone = (f->end < at + n ? f->end + 1 : at + n) - at;
+        f->end -= gone;
+        if(f->end <= f->start)
+            foldRemove(i);
+    }
+    if(changed)
+        foldReindex();
+}
+
+/*** fold regions ***/
+
+static int foldIndent(erow *row, int *blank){
+    //width of the leading whitespace, blank is set for rows with nothing else on them
+    int i, w = 0;
+    for(i = 0; i < row->size && (row->chars[i] == ' ' || row->chars[i] == '\t'); i++)
+        w = row->chars[i] == '\t' ? (w / TAB_STOP + 1) * TAB_STOP : w + 1;
+    *blank = i == row->size;
+    return w;
+}
+
+struct braceScan{
+    int depth;
+    //set while inside a /* */ comment that carries on to the next row
+    int comment;
+};
+
+static int foldScanRow(erow *row, struct braceScan *s, int *opened){
+    //counts brackets on a row, skipping string and character literals and comments
+    //returns the column where depth drops back to zero, or -1, and sets opened when the row leaves a bracket open from depth zero
+    int i;
+    int start = s->depth;
+    *opened = 0;
+    for(i = 0; i < row->size; i++){
+        char c = row->chars[i];
+        if(s->comment){
+            if(c == '*' && i + 1 < row->size && row->chars[i + 1] == '/'){
+                s->comment = 0;
+                i++;
+            }
+            continue;
+        }
+        if(c == '/' && i + 1 < row->size && row->chars[i + 1] == '/')
+            break;
+        if(c == '/' && i + 1 < row->size && row->chars[i + 1] == '*'){
+            s->comment = 1;
+            i++;
+            continue;
+        }
+        if(c == '"' || c == '\''){
+            for(i++; i < row->size && row->chars[i] != c; i++){
+                if(row->chars[i] == '\\')
+                    i++;
+            }
+            continue;
+        }
+        if(c == '{' || c == '[' || c == '('){
+            s->depth++;
+        }
+        else if(c == '}' || c == ']' || c == ')'){
+            if(s->depth > 0)
+                s->depth--;
+            if(s->depth == 0 && start > 0)
+                return i;
+        }
+    }
+    *opened = start == 0 && s->depth > 0;
+    return -1;
+}
+
+int foldRegion(int at, int *end){
+    //finds the rows that folding at row at would hide: up to the row closing a bracket left open on it, or else the rows indented deeper below it
+    if(at < 0 || at >= e.numrows)
+        return 0;
+    struct braceScan s = {0, 0};
+    int opened, y, blank, atblank;
+    int indent = foldIndent(&e.row[at], &atblank);
+    foldScanRow(&e.row[at], &s, &opened);
+    if(opened){
+        //the closing bracket is only looked for up to the first row indented no deeper than this one, so a bracket that is never closed
+        //doesn't send every row's scan to the end of the file, the indentation rule covers that case instead
+        for(y = at + 1; y < e.numrows; y++){
+            if(foldScanRow(&e.row[y], &s, &opened) != -1 || s.depth == 0){
+                *end = y;
+                return y > at;
+            }
+            int w = foldIndent(&e.row[y], &blank);
+            if(!blank && w <= indent)
+                break;
+        }
+    }
+
+    if(atblank)
+        return 0;
+    int last = at;
+    for(y = at + 1; y < e.numrows; y++){
+        int w = foldIndent(&e.row[y], &blank);
+        if(blank)
+            continue;
+        if(w <= indent)
+            break;
+        last = y;
+    }
+    *end = last;
+    return last > at;
+}
+
+/*** commands ***/
+
+void editorToggleFold(){
+    //opens the fold under the cursor, or closes the block that starts on the cursor row
+    int end;
+    if(e.cy >= e.numrows)
+        return;
+    if(foldOpen(e.cy))
+        return;
+    if(!foldRegion(e.cy, &end)){
+        editorSetStatusMessage("Nothing to fold here");
+        return;
+    }
+    foldClose(e.cy, end);
+}
+
+void editorToggleAllFolds(){
+    //opens every fold, or when there are none, folds every top level block in one pass over the file
+    int y, end;
+    if(numfolds){
+        foldClear();
+        editorSetStatusMessage("All folds opened");
+        return;
+    }
+    for(y = 0; y < e.numrows; y++){
+        if(foldRegion(y, &end)){
+            folds = realloc(folds, sizeof(struct fold) * (numfolds + 1));
+            folds[numfolds].start = y;
+            folds[numfolds].end = end;
+            numfolds++;
+            y = end;
+        }
+    }
+    foldReindex();
+    e.cy = foldVisible(e.cy < e.numrows ? e.cy : e.numrows);
+    editorSetStatusMessage("%d blocks folded", numfolds);
+}
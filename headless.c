@@ -0,0 +1,324 @@
+/*** includes ***/
+
+#include "headless.h"
+
+#include<ctype.h>
+#include<errno.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+
+/*** virtual screen ***/
+
+void vscreenInit(struct vscreen *vs, int rows, int cols){
+    vs->rows = rows;
+    vs->cols = cols;
+    vs->cy = 0;
+    vs->cx = 0;
+    vs->cursor_visible = 1;
+    vs->cells = malloc((size_t)rows * cols);
+    memset(vs->cells, ' ', (size_t)rows * cols);
+}
+
+void vscreenFree(struct vscreen *vs){
+    free(vs->cells);
+    vs->cells = NULL;
+}
+
+static void vscreenPut(struct vscreen *vs, char c){
+    //characters past the right edge are dropped, the editor never relies on autowrap
+    if(vs->cy < vs->rows && vs->cx < vs->cols)
+        vs->cells[vs->cy * vs->cols + vs->cx] = c;
+    vs->cx++;
+}
+
+static void vscreenCsi(struct vscreen *vs, int *params, int nparams, int private, char cmd){
+    int y;
+    switch(cmd){
+        case 'H':
+            //cursor position, parameters are 1 indexed and default to 1
+            vs->cy = (nparams > 0 && params[0] > 0 ? params[0] : 1) - 1;
+            vs->cx = (nparams > 1 && params[1] > 0 ? params[1] : 1) - 1;
+            break;
+        case 'K':
+            //erase to the end of the line
+            if(vs->cy < vs->rows && vs->cx < vs->cols)
+                memset(&vs->cells[vs->cy * vs->cols + vs->cx], ' ', vs->cols - vs->cx);
+            break;
+        case 'J':
+            if(nparams > 0 && params[0] == 2){
+                for(y = 0; y < vs->rows; y++)
+                    memset(&vs->cells[y * vs->cols], ' ', vs->cols);
+            }
+            break;
+        case 'h':
+        case 'l':
+            if(private && nparams > 0 && params[0] == 25)
+                vs->cursor_visible = (cmd == 'h');
+            break;
+        default:
+            //colours and anything else only change attributes, which the virtual screen does not track
+            break;
+    }
+}
+
+void vscreenFeed(struct vscreen *vs, const char *s, size_t len){
+    size_t i = 0;
+    while(i < len){
+        char c = s[i++];
+        if(c == '\x1b' && i < len && s[i] == '['){
+            int params[8];
+            int nparams = 0;
+            int private = 0;
+            int cur = -1;
+            i++;
+            if(i < len && s[i] == '?'){
+                private = 1;
+                i++;
+            }
+            //collects the numeric parameters up to the final byte of the sequence
+            while(i < len && (isdigit((unsigned char)s[i]) || s[i] == ';')){
+                if(s[i] == ';'){
+                    if(nparams < 8)
+                        params[nparams++] = cur < 0 ? 0 : cur;
+                    cur = -1;
+                }
+                else{
+                    cur = (cur < 0 ? 0 : cur * 10) + (s[i] - '0');
+                }
+                i++;
+            }
+            if(cur >= 0 && nparams < 8)
+                params[nparams++] = cur;
+            if(i < len)
+                vscreenCsi(vs, params, nparams, private, s[i++]);
+        }
+        else if(c == '\r'){
+            vs->cx = 0;
+        }
+        else if(c == '\n'){
+            if(vs->cy < vs->rows - 1)
+                vs->cy++;
+        }
+        else{
+            vscreenPut(vs, c);
+        }
+    }
+}
+
+void vscreenDump(struct vscreen *vs, FILE *fp){
+    int y;
+    for(y = 0; y < vs->rows; y++){
+        //trailing blanks are trimmed so dumps are easy to diff
+        int len = vs->cols;
+        while(len > 0 && vs->cells[y * vs->cols + len - 1] == ' ')
+            len--;
+        fwrite(&vs->cells[y * vs->cols], 1, len, fp);
+        fputc('\n', fp);
+    }
+}
+
+/*** headless driver ***/
+
+//every scripted key, each stored as the raw bytes a terminal would send for it
+static struct{
+    char **keys;
+    size_t *lens;
+    int count;
+    int cap;
+    //index of the next key to hand over to editorReadKey
+    int next;
+}script;
+
+//end of the key data written to e.ifd so far
+static off_t keys_written;
+
+struct vscreen *headless_screen = NULL;
+static struct vscreen screen;
+FILE *headless_raw = NULL;
+
+static int headlessRefill(){
+    //called by editorReadKey when e.ifd has been drained, it writes exactly one more key so escape sequences are never glued together
+    if(script.next >= script.count)
+        return 0;
+    int k = script.next++;
+    if(pwrite(e.ifd, script.keys[k], script.lens[k], keys_written) != (ssize_t)script.lens[k])
+        die("pwrite");
+    keys_written += script.lens[k];
+    return 1;
+}
+
+void headlessInit(int rows, int cols){
+    headlessShutdown();
+    editorReset();
+    e.screenrows = rows - 2;
+    e.screencols = cols;
+    e.headless = 1;
+    e.keysource = headlessRefill;
+
+    //both ends are anonymous temporary files, keys are appended to one and frames are drained from the other after every step
+    FILE *in = tmpfile();
+    FILE *out = tmpfile();
+    if(!in || !out)
+        die("tmpfile");
+    e.ifd = dup(fileno(in));
+    e.ofd = dup(fileno(out));
+    fclose(in);
+    fclose(out);
+    keys_written = 0;
+}
+
+void headlessShutdown(){
+    int i;
+    for(i = 0; i < script.count; i++)
+        free(script.keys[i]);
+    free(script.keys);
+    free(script.lens);
+    memset(&script, 0, sizeof(script));
+    if(e.headless){
+        close(e.ifd);
+        close(e.ofd);
+        e.headless = 0;
+    }
+    headlessTrackScreen(0);
+}
+
+void headlessTrackScreen(int on){
+    if(headless_screen){
+        vscreenFree(headless_screen);
+        headless_screen = NULL;
+    }
+    if(on){
+        vscreenInit(&screen, e.screenrows + 2, e.screencols);
+        headless_screen = &screen;
+    }
+}
+
+void headlessQueueKey(const char *bytes, size_t len){
+    if(script.count == script.cap){
+        script.cap = script.cap ? script.cap * 2 : 64;
+        script.keys = realloc(script.keys, sizeof(char *) * script.cap);
+        script.lens = realloc(script.lens, sizeof(size_t) * script.cap);
+    }
+    script.keys[script.count] = malloc(len);
+    memcpy(script.keys[script.count], bytes, len);
+    script.lens[script.count] = len;
+    script.count++;
+}
+
+void headlessPaste(){
+    //writes every queued key to e.ifd at once, so they are all waiting when the editor reads the first one
+    while(headlessRefill())
+        ;
+}
+
+int headlessPendingKeys(){
+    //keys not yet handed over plus whatever is still unread in e.ifd
+    off_t pos = lseek(e.ifd, 0, SEEK_CUR);
+    return (script.count - script.next) + (pos < keys_written);
+}
+
+//names understood between angle brackets in a key script and the bytes a terminal sends for them
+static const struct{
+    const char *name;
+    const char *bytes;
+}keynames[] = {
+    {"CR", "\r"},
+    {"Esc", "\x1b"},
+    {"BS", "\x7f"},
+    {"Del", "\x1b[3~"},
+    {"Up", "\x1b[A"},
+    {"Down", "\x1b[B"},
+    {"Right", "\x1b[C"},
+    {"Left", "\x1b[D"},
+    {"Home", "\x1b[H"},
+    {"End", "\x1b[F"},
+    {"PageUp", "\x1b[5~"},
+    {"PageDown", "\x1b[6~"},
+    {"S-Up", "\x1b[1;2A"},
+    {"S-Down", "\x1b[1;2B"},
+    {"S-Right", "\x1b[1;2C"},
+    {"S-Left", "\x1b[1;2D"},
+    {"Tab", "\t"},
+    {"lt", "<"},
+};
+
+int headlessQueueScript(const char *text){
+    const char *p = text;
+    while(*p){
+        if(*p == '<'){
+            const char *end = strchr(p, '>');
+            if(!end)
+                return -1;
+            size_t n = end - p - 1;
+            size_t k;
+            int found = 0;
+            //<C-x> is ctrl + x
+            if(n == 3 && p[1] == 'C' && p[2] == '-'){
+                char c = CTRL_KEY(p[3]);
+                headlessQueueKey(&c, 1);
+                found = 1;
+            }
+            for(k = 0; !found && k < sizeof(keynames) / sizeof(keynames[0]); k++){
+                if(strlen(keynames[k].name) == n && strncmp(keynames[k].name, p + 1, n) == 0){
+                    headlessQueueKey(keynames[k].bytes, strlen(keynames[k].bytes));
+                    found = 1;
+                }
+            }
+            if(!found)
+                return -1;
+            p = end + 1;
+        }
+        else if(*p == '\n'){
+            //newlines only separate lines of a script file, use <CR> to press enter
+            p++;
+        }
+        else{
+            headlessQueueKey(p, 1);
+            p++;
+        }
+    }
+    return 0;
+}
+
+static size_t headlessDrain(){
+    //reads the frame(s) written since the last drain, feeds them to the virtual screen and empties ofd again
+    off_t end = lseek(e.ofd, 0, SEEK_CUR);
+    if(end <= 0)
+        return 0;
+    if(headless_screen || headless_raw){
+        char buf[8192];
+        off_t off = 0;
+        while(off < end){
+            ssize_t n = pread(e.ofd, buf, sizeof(buf), off);
+            if(n <= 0)
+                break;
+            if(headless_screen)
+                vscreenFeed(headless_screen, buf, n);
+            if(headless_raw)
+                fwrite(buf, 1, n, headless_raw);
+            off += n;
+        }
+    }
+    if(ftruncate(e.ofd, 0) == -1)
+        die("ftruncate");
+    lseek(e.ofd, 0, SEEK_SET);
+    return end;
+}
+
+size_t headlessStep(){
+    //like the editor's main loop, keys that were pasted in one go are drawn as one frame
+    editorProcessKeypress();
+    headlessDrain();
+    if(editorFrameDue())
+        editorRefreshScreen();
+    return headlessDrain();
+}
+
+void headlessRun(){
+    headlessDrain();
+    editorRefreshScreen();
+    headlessDrain();
+    while(headlessPendingKeys())
+        headlessStep();
+}
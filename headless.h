@@ -0,0 +1,51 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "editor.h"
+
+#include<stdio.h>
+
+/*** virtual screen ***/
+
+//a tiny terminal emulator that understands the handful of escape sequences the editor emits
+struct vscreen{
+    int rows;
+    int cols;
+    //current cursor position, 0 indexed
+    int cy, cx;
+    int cursor_visible;
+    //rows * cols cells, row major
+    char *cells;
+};
+
+void vscreenInit(struct vscreen *vs, int rows, int cols);
+void vscreenFree(struct vscreen *vs);
+void vscreenFeed(struct vscreen *vs, const char *s, size_t len);
+void vscreenDump(struct vscreen *vs, FILE *fp);
+
+/*** headless driver ***/
+
+//puts the editor in headless mode on a virtual screen of rows x cols (the last two rows are the status and message bars)
+void headlessInit(int rows, int cols);
+void headlessShutdown();
+
+//queues the raw terminal bytes of a single key, each key is handed to editorReadKey only when it asks for more input
+void headlessQueueKey(const char *bytes, size_t len);
+//parses a key script such as "hello<CR><C-s><Up>" and queues every key in it, returns -1 on an unknown <name>
+int headlessQueueScript(const char *text);
+//hands every queued key over at once, the way a terminal delivers a paste, instead of one per read
+void headlessPaste();
+int headlessPendingKeys();
+
+//runs editorProcessKeypress followed by editorRefreshScreen when a frame is due, returns the number of bytes the step emitted
+size_t headlessStep();
+//replays every queued key, one step per key
+void headlessRun();
+
+//virtual screen that mirrors every frame, NULL unless headlessInit was asked to track it
+extern struct vscreen *headless_screen;
+void headlessTrackScreen(int on);
+//when set, every byte the editor writes to the terminal is copied here as well
+extern FILE *headless_raw;
+
+#endif
@@ -0,0 +1,408 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<ctype.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#ifdef __SSE2__
+#include<emmintrin.h>
+#endif
+
+#include "alloc.h"
+
+/*** data ***/
+
+#define HEX_BYTES_PER_ROW 16
+//files with a NUL byte in this many leading bytes are binary
+#define HEX_SNIFF_BYTES 8192
+//and so are files with no newline in this many, which would make one unusably long row
+#define HEX_MAX_LINE (1 << 20)
+//patched bytes are written back a page at a time
+#define HEX_PAGE 4096
+
+//the file is mapped privately and never copied into rows, patches change the mapping and are written back on save
+static struct{
+    int active;
+    unsigned char *map;
+    size_t size;
+    //byte the cursor is on, and whether it is on the low nibble of it
+    size_t cursor;
+    int low;
+    //first row on screen
+    size_t rowoff;
+    //digits the offset column is drawn with
+    int offdigits;
+    //one bit per page with patched bytes in it
+    unsigned char *dirty;
+    //the file as it was mapped or last saved, a save first checks that nothing else has written to it since
+    dev_t dev;
+    ino_t ino;
+    off_t disksize;
+    struct timespec mtime;
+} hex;
+
+/*** encoding ***/
+
+static void hexEncode16(const unsigned char *in, char *out){
+    //writes the 32 lowercase hex digits of 16 bytes
+#ifdef __SSE2__
+    __m128i v = _mm_loadu_si128((const __m128i *)in);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    __m128i lo = _mm_and_si128(v, mask);
+    //a nibble n becomes '0' + n, plus the distance from '9' + 1 to 'a' when n is over 9
+    __m128i nine = _mm_set1_epi8(9);
+    __m128i zero = _mm_set1_epi8('0');
+    __m128i gap = _mm_set1_epi8('a' - '0' - 10);
+    hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), gap));
+    lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), gap));
+    //interleaving puts each high digit in front of its low digit
+    _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi8(hi, lo));
+#else
+    static const char digits[] = "0123456789abcdef";
+    int i;
+    for(i = 0; i < 16; i++){
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0f];
+    }
+#endif
+}
+
+static int hexFormatRow(size_t row, char *out){
+    //one screen row: the offset, 16 bytes in hex with a gap after the eighth, and the same bytes as text
+    size_t at = row * HEX_BYTES_PER_ROW;
+    int n = hex.size - at < HEX_BYTES_PER_ROW ? hex.size - at : HEX_BYTES_PER_ROW;
+    unsigned char bytes[HEX_BYTES_PER_ROW] = {0};
+    char digits[HEX_BYTES_PER_ROW * 2];
+    int i, len;
+    memcpy(bytes, hex.map + at, n);
+    hexEncode16(bytes, digits);
+    len = sprintf(out, "%0*zx  ", hex.offdigits, at);
+    for(i = 0; i < HEX_BYTES_PER_ROW; i++){
+        if(i == HEX_BYTES_PER_ROW / 2)
+            out[len++] = ' ';
+        out[len++] = i < n ? digits[2 * i] : ' ';
+        out[len++] = i < n ? digits[2 * i + 1] : ' ';
+        out[len++] = ' ';
+    }
+    out[len++] = ' ';
+    out[len++] = '|';
+    for(i = 0; i < n; i++)
+        out[len++] = isprint(bytes[i]) ? bytes[i] : '.';
+    out[len++] = '|';
+    return len;
+}
+
+/*** opening ***/
+
+int hexActive(){
+    return hex.active;
+}
+
+int hexDetect(const unsigned char *map, size_t size){
+    //binary files have NUL bytes near the start, and a file is treated the same when its first line never ends
+    size_t sniff = size < HEX_SNIFF_BYTES ? size : HEX_SNIFF_BYTES;
+    size_t line = size < HEX_MAX_LINE ? size : HEX_MAX_LINE;
+    if(memchr(map, '\0', sniff))
+        return 1;
+    return size >= HEX_MAX_LINE && !memchr(map, '\n', line);
+}
+
+static void hexStamp(int fd){
+    struct stat st;
+    if(fstat(fd, &st) == -1)
+        return;
+    hex.dev = st.st_dev;
+    hex.ino = st.st_ino;
+    hex.disksize = st.st_size;
+    hex.mtime = st.st_mtim;
+}
+
+static int hexChangedOnDisk(){
+    //whether the file was replaced, resized or written since it was stamped
+    struct stat st;
+    if(stat(e.filename, &st) == -1)
+        return 1;
+    return st.st_dev != hex.dev || st.st_ino != hex.ino || st.st_size != hex.disksize ||
+        st.st_mtim.tv_sec != hex.mtime.tv_sec || st.st_mtim.tv_nsec != hex.mtime.tv_nsec;
+}
+
+int hexOpen(int fd, size_t size){
+    //maps the file copy on write, so patching a byte never touches the file until it is saved
+    unsigned char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED)
+        return -1;
+    hexClose();
+    hexStamp(fd);
+    madvise(map, size, MADV_RANDOM);
+    hex.active = 1;
+    hex.map = map;
+    hex.size = size;
+    hex.dirty = calloc(size / HEX_PAGE / 8 + 1, 1);
+    hex.offdigits = 8;
+    while(hex.offdigits < 16 && (size - 1) >> (hex.offdigits * 4))
+        hex.offdigits++;
+    return 0;
+}
+
+void hexClose(){
+    if(hex.map)
+        munmap(hex.map, hex.size);
+    free(hex.dirty);
+    memset(&hex, 0, sizeof(hex));
+}
+
+/*** drawing ***/
+
+void hexScroll(){
+    size_t row = hex.cursor / HEX_BYTES_PER_ROW;
+    if(row < hex.rowoff)
+        hex.rowoff = row;
+    if(row >= hex.rowoff + e.screenrows)
+        hex.rowoff = row - e.screenrows + 1;
+}
+
+void hexDrawRows(struct abuf *ab){
+    //only the rows on screen are read from the mapping and formatted
+    size_t rows = (hex.size + HEX_BYTES_PER_ROW - 1) / HEX_BYTES_PER_ROW;
+    char line[128];
+    int y;
+    for(y = 0; y < e.screenrows; y++){
+        size_t row = hex.rowoff + y;
+        if(row < rows){
+            int len = hexFormatRow(row, line);
+            abAppend(ab, line, len < e.screencols ? len : e.screencols);
+        }
+        else{
+            abAppend(ab, "~", 1);
+        }
+        abAppend(ab, "\x1b[K", 3);
+        abAppend(ab, "\r\n", 2);
+    }
+}
+
+void hexCursorPosition(int *row, int *col){
+    //screen position of the nibble the cursor is on, 1 indexed
+    int i = hex.cursor % HEX_BYTES_PER_ROW;
+    *row = hex.cursor / HEX_BYTES_PER_ROW - hex.rowoff + 1;
+    *col = hex.offdigits + 2 + i * 3 + (i >= HEX_BYTES_PER_ROW / 2) + hex.low + 1;
+}
+
+int hexStatus(char *status, size_t len, char *rstatus, size_t rlen, int *rstatuslen){
+    *rstatuslen = snprintf(rstatus, rlen, "0x%zx/0x%zx", hex.cursor, hex.size);
+    return snprintf(status, len, "%.20s - %zu bytes (hex) %s", e.filename ? e.filename : "[No Name]", hex.size, e.dirty ? "modified" : "");
+}
+
+/*** editing ***/
+
+static void hexPatch(int digit){
+    //overwrites the nibble under the cursor and moves on to the next one
+    unsigned char *b = &hex.map[hex.cursor];
+    *b = hex.low ? (*b & 0xf0) | digit : (*b & 0x0f) | (digit << 4);
+    hex.dirty[hex.cursor / HEX_PAGE / 8] |= 1 << (hex.cursor / HEX_PAGE % 8);
+    e.dirty++;
+    if(!hex.low){
+        hex.low = 1;
+    }
+    else if(hex.cursor + 1 < hex.size){
+        hex.low = 0;
+        hex.cursor++;
+    }
+}
+
+void hexSave(){
+    //the file keeps its size, so only the pages with patched bytes are written back, in place
+    size_t page, pages = (hex.size + HEX_PAGE - 1) / HEX_PAGE, written = 0;
+    //the mapping can't be merged with another program's changes, so like the text view it only overwrites them when told to
+    if(hexChangedOnDisk() && !editorConfirm("The file on disk has changes that are not in the buffer, overwrite them?")){
+        editorSetStatusMessage("Save aborted");
+        return;
+    }
+    int fd = open(e.filename, O_WRONLY);
+    if(fd == -1){
+        editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+        return;
+    }
+    for(page = 0; page < pages; page++){
+        if(!(hex.dirty[page / 8] & (1 << (page % 8))))
+            continue;
+        size_t off = page * HEX_PAGE;
+        size_t len = hex.size - off < HEX_PAGE ? hex.size - off : HEX_PAGE;
+        size_t done = 0;
+        while(done < len){
+            ssize_t n = pwrite(fd, hex.map + off + done, len - done, off + done);
+            if(n == -1){
+                close(fd);
+                editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+                return;
+            }
+            done += n;
+        }
+        written += len;
+    }
+    if(fsync(fd) == -1){
+        close(fd);
+        editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+        return;
+    }
+    hexStamp(fd);
+    if(close(fd) == -1){
+        editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+        return;
+    }
+    memset(hex.dirty, 0, hex.size / HEX_PAGE / 8 + 1);
+    e.dirty = 0;
+    editorSetStatusMessage("%zu bytes written to disk", written);
+}
+
+/*** search ***/
+
+static int hexParsePattern(const char *query, unsigned char *out){
+    //"text" in quotes is searched for as it is, anything else is hex digits with optional spaces, returns the length or -1
+    int n = 0, half = -1;
+    if(query[0] == '"'){
+        for(query++; *query && *query != '"'; query++)
+            out[n++] = *query;
+        return n;
+    }
+    for(; *query; query++){
+        if(*query == ' ')
+            continue;
+        if(!isxdigit((unsigned char)*query))
+            return -1;
+        int d = isdigit((unsigned char)*query) ? *query - '0' : tolower((unsigned char)*query) - 'a' + 10;
+        if(half == -1){
+            half = d;
+        }
+        else{
+            out[n++] = half << 4 | d;
+            half = -1;
+        }
+    }
+    return n;
+}
+
+static size_t hexSearch(const unsigned char *pat, int len, size_t from, int direction){
+    //offset of the next match from from on (or back from it), wrapping round the file, or hex.size when there is none
+    size_t i;
+    if((size_t)len > hex.size)
+        return hex.size;
+    size_t last = hex.size - len;
+    if(direction > 0){
+        const unsigned char *p = memmem(hex.map + from, hex.size - from, pat, len);
+        if(!p && from > 0)
+            p = memmem(hex.map, from + len - 1 < hex.size ? from + len - 1 : hex.size, pat, len);
+        return p ? (size_t)(p - hex.map) : hex.size;
+    }
+    from = from > last ? last : from;
+    for(i = 0; i <= last; i++){
+        size_t at = (from + last + 1 - i) % (last + 1);
+        if(hex.map[at] == pat[0] && !memcmp(hex.map + at, pat, len))
+            return at;
+    }
+    return hex.size;
+}
+
+static size_t search_start;
+
+static void hexFindCallback(char *query, int key){
+    //like the text search, every key searches again from where the search began, and the arrows go to the next or the previous match
+    unsigned char *pat = malloc(strlen(query) + 1);
+    int len = hexParsePattern(query, pat);
+    size_t from = search_start;
+    int direction = 1;
+    if(key == ARROW_RIGHT || key == ARROW_DOWN)
+        from = hex.cursor + 1 < hex.size ? hex.cursor + 1 : 0;
+    else if(key == ARROW_LEFT || key == ARROW_UP){
+        from = hex.cursor > 0 ? hex.cursor - 1 : hex.size - 1;
+        direction = -1;
+    }
+    if(key != '\r' && key != '\x1b' && len > 0){
+        size_t at = hexSearch(pat, len, from, direction);
+        if(at < hex.size){
+            hex.cursor = at;
+            hex.low = 0;
+        }
+    }
+    free(pat);
+}
+
+static void hexFind(){
+    size_t saved_cursor = hex.cursor, saved_rowoff = hex.rowoff;
+    search_start = hex.cursor;
+    char *query = editorPrompt("Search bytes: %s (hex, or \"text\")", hexFindCallback);
+    if(query){
+        free(query);
+    }
+    else{
+        hex.cursor = saved_cursor;
+        hex.rowoff = saved_rowoff;
+    }
+}
+
+/*** input ***/
+
+int hexProcessKey(int c){
+    //handles every key of the hex view, except the ones the editor deals with the same way in both views
+    size_t rows = e.screenrows * HEX_BYTES_PER_ROW;
+    switch(c){
+        case CTRL_KEY('q'):
+        case CTRL_KEY('s'):
+        case CTRL_KEY('p'):
+            return 0;
+        case CTRL_KEY('f'):
+            hexFind();
+            break;
+        case ARROW_LEFT:
+            if(hex.low)
+                hex.low = 0;
+            else if(hex.cursor > 0)
+                hex.cursor--;
+            break;
+        case ARROW_RIGHT:
+            hex.low = 0;
+            if(hex.cursor + 1 < hex.size)
+                hex.cursor++;
+            break;
+        case ARROW_UP:
+            if(hex.cursor >= HEX_BYTES_PER_ROW)
+                hex.cursor -= HEX_BYTES_PER_ROW;
+            break;
+        case ARROW_DOWN:
+            if(hex.cursor + HEX_BYTES_PER_ROW < hex.size)
+                hex.cursor += HEX_BYTES_PER_ROW;
+            break;
+        case PAGE_UP:
+            hex.cursor = hex.cursor > rows ? hex.cursor - rows : hex.cursor % HEX_BYTES_PER_ROW;
+            break;
+        case PAGE_DOWN:
+            if(hex.size - hex.cursor > rows)
+                hex.cursor += rows;
+            break;
+        case HOME_KEY:
+            hex.cursor -= hex.cursor % HEX_BYTES_PER_ROW;
+            hex.low = 0;
+            break;
+        case END_KEY:
+            hex.cursor += HEX_BYTES_PER_ROW - 1 - hex.cursor % HEX_BYTES_PER_ROW;
+            if(hex.cursor >= hex.size)
+                hex.cursor = hex.size - 1;
+            hex.low = 0;
+            break;
+        default:
+            //hex digits patch the byte under the cursor, nothing else can change the file
+            if(c < 128 && isxdigit(c))
+                hexPatch(isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+            break;
+    }
+    return 1;
+}
@@ -0,0 +1,633 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<errno.h>
+#include<fcntl.h>
+#include<libgen.h>
+#include<pthread.h>
+#include<signal.h>
+#include<stdint.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include "alloc.h"
+
+/*** defines ***/
+
+//the swap file starts with a header identifying the original file, followed by one record per row operation
+//records are written in host byte order, a swap file is only ever read back on the machine that wrote it
+#define JOURNAL_MAGIC "EDSWAP01"
+#define JOURNAL_HEADER_SIZE 32
+#define JOURNAL_RECORD_SIZE 13
+
+//pending records are written out once this many bytes pile up, and fsynced once the user stops typing
+#define JOURNAL_FLUSH_BYTES (64 * 1024)
+#define JOURNAL_IDLE_MS 500
+//a compaction starts once the swap file is past this size and has doubled since the last one
+#define JOURNAL_COMPACT_BYTES (1024 * 1024)
+
+/*** data ***/
+
+struct journalOp{
+    int type;
+    uint32_t row;
+    uint32_t pos;
+    uint32_t len;
+    char *data;
+};
+
+static struct{
+    //-1 while nothing is being journaled
+    int fd;
+    char *path;
+    //records that haven't been written to fd yet
+    char *buf;
+    size_t len;
+    size_t cap;
+    int unsynced;
+    double lastop;
+    int suspended;
+    off_t filesize;
+    off_t compactedsize;
+
+    //background compaction, the worker only touches the fields below under the lock
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int compacting;
+    int compactdone;
+    int compactok;
+    off_t compactupto;
+    char *tmppath;
+}journal = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static volatile sig_atomic_t journal_hangup = 0;
+
+/*** helpers ***/
+
+static double journalNowMs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+char *journalPath(const char *filename){
+    //the swap file lives next to the file as .<name>.swp, the way vim names its swap files
+    char *dcopy = strdup(filename);
+    char *bcopy = strdup(filename);
+    char *dir = dirname(dcopy);
+    char *base = basename(bcopy);
+    size_t len = strlen(dir) + strlen(base) + 7;
+    char *path = malloc(len);
+    snprintf(path, len, "%s/.%s.swp", dir, base);
+    free(dcopy);
+    free(bcopy);
+    return path;
+}
+
+static void journalHeader(char *hdr, const char *filename){
+    //identifies the version of the original file the records apply to
+    struct stat st;
+    uint64_t size = 0, ino = 0;
+    int64_t mtime = 0;
+    if(stat(filename, &st) == 0){
+        size = st.st_size;
+        ino = st.st_ino;
+        mtime = st.st_mtime;
+    }
+    memcpy(hdr, JOURNAL_MAGIC, 8);
+    memcpy(hdr + 8, &size, 8);
+    memcpy(hdr + 16, &ino, 8);
+    memcpy(hdr + 24, &mtime, 8);
+}
+
+static int writeAll(int fd, const char *buf, size_t len){
+    while(len > 0){
+        ssize_t n = write(fd, buf, len);
+        if(n == -1 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static uint32_t journalDataLen(int type, uint32_t len){
+    //only insertions carry text, for a deleted range len is the number of characters removed
+    return (type == JOURNAL_INSERT_ROW || type == JOURNAL_INSERT_STR) ? len : 0;
+}
+
+static void journalAppendRecord(char **buf, size_t *len, size_t *cap, int type, uint32_t row, uint32_t pos, const char *s, uint32_t slen){
+    uint32_t datalen = journalDataLen(type, slen);
+    size_t need = *len + JOURNAL_RECORD_SIZE + datalen;
+    if(need > *cap){
+        *cap = need * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    char *p = *buf + *len;
+    p[0] = type;
+    memcpy(p + 1, &row, 4);
+    memcpy(p + 5, &pos, 4);
+    memcpy(p + 9, &slen, 4);
+    if(datalen)
+        memcpy(p + JOURNAL_RECORD_SIZE, s, datalen);
+    *len = need;
+}
+
+static int journalParse(const char *buf, size_t len, size_t *off, struct journalOp *op){
+    //reads the record at *off, returns 0 at the end of the data or on a record cut short by a crash
+    if(*off + JOURNAL_RECORD_SIZE > len)
+        return 0;
+    const char *p = buf + *off;
+    op->type = p[0];
+    memcpy(&op->row, p + 1, 4);
+    memcpy(&op->pos, p + 5, 4);
+    memcpy(&op->len, p + 9, 4);
+    uint32_t datalen = journalDataLen(op->type, op->len);
+    if(*off + JOURNAL_RECORD_SIZE + datalen > len)
+        return 0;
+    op->data = (char *)p + JOURNAL_RECORD_SIZE;
+    *off += JOURNAL_RECORD_SIZE + datalen;
+    return 1;
+}
+
+static char *readFile(const char *path, size_t *len){
+    int fd = open(path, O_RDONLY);
+    if(fd == -1)
+        return NULL;
+    struct stat st;
+    if(fstat(fd, &st) == -1){
+        close(fd);
+        return NULL;
+    }
+    char *buf = malloc(st.st_size + 1);
+    size_t done = 0;
+    while(done < (size_t)st.st_size){
+        ssize_t n = read(fd, buf + done, st.st_size - done);
+        if(n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+    *len = done;
+    return buf;
+}
+
+/*** journal ***/
+
+static void journalHangup(int sig){
+    //only a flag is set here, editorReadKey is interrupted and the swap file is synced from journalIdle
+    (void)sig;
+    journal_hangup = 1;
+}
+
+void journalInstallSignals(){
+    //a dropped ssh session sends SIGHUP, the pending records are synced before the editor goes away
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = journalHangup;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+void journalStart(const char *filename, int keep){
+    //starts journaling edits of filename, keep appends to an existing swap file instead of starting a new one
+    journalStop(0);
+    journal.path = journalPath(filename);
+    journal.fd = open(journal.path, O_RDWR | O_CREAT | O_APPEND | (keep ? 0 : O_TRUNC), 0600);
+    if(journal.fd == -1){
+        free(journal.path);
+        journal.path = NULL;
+        return;
+    }
+    journal.filesize = lseek(journal.fd, 0, SEEK_END);
+    if(journal.filesize < JOURNAL_HEADER_SIZE){
+        char hdr[JOURNAL_HEADER_SIZE];
+        journalHeader(hdr, filename);
+        if(ftruncate(journal.fd, 0) == -1 || writeAll(journal.fd, hdr, sizeof(hdr)) == -1){
+            journalStop(1);
+            return;
+        }
+        journal.filesize = JOURNAL_HEADER_SIZE;
+    }
+    journal.compactedsize = journal.filesize;
+    journal.len = 0;
+    journal.unsynced = 0;
+}
+
+static void journalJoinCompaction(){
+    if(!journal.compacting)
+        return;
+    pthread_join(journal.thread, NULL);
+    journal.compacting = 0;
+    if(journal.tmppath){
+        unlink(journal.tmppath);
+        free(journal.tmppath);
+        journal.tmppath = NULL;
+    }
+}
+
+void journalStop(int remove){
+    //closes the swap file, remove deletes it as well (after a save or a clean quit)
+    journalJoinCompaction();
+    if(journal.fd == -1)
+        return;
+    if(remove)
+        unlink(journal.path);
+    else
+        journalFlush(1);
+    close(journal.fd);
+    journal.fd = -1;
+    free(journal.path);
+    journal.path = NULL;
+    journal.len = 0;
+}
+
+void journalSuspend(int on){
+    //while suspended, row operations aren't journaled, used when loading a file or replaying a journal
+    journal.suspended = on;
+}
+
+void journalRecord(int type, int row, int pos, const char *s, size_t len){
+    if(journal.fd == -1 || journal.suspended)
+        return;
+    journalAppendRecord(&journal.buf, &journal.len, &journal.cap, type, row, pos, s, len);
+    journal.lastop = journalNowMs();
+    if(journal.len >= JOURNAL_FLUSH_BYTES)
+        journalFlush(0);
+}
+
+void journalFlush(int sync){
+    if(journal.fd == -1)
+        return;
+    if(journal.len){
+        if(writeAll(journal.fd, journal.buf, journal.len) == 0){
+            journal.filesize += journal.len;
+            journal.unsynced = 1;
+        }
+        journal.len = 0;
+    }
+    if(sync && journal.unsynced){
+        fsync(journal.fd);
+        journal.unsynced = 0;
+    }
+}
+
+/*** compaction ***/
+
+static int journalCoalesce(struct journalOp *p, struct journalOp *q, char **scratch){
+    //tries to fold q into the pending op p, returns 1 if q was absorbed
+    //scratch holds p's data once it has been rewritten, since it no longer points into the input
+    if(p->type == JOURNAL_INSERT_ROW && q->row == p->row && q->type != JOURNAL_INSERT_ROW){
+        //edits to a freshly inserted row just change what gets inserted
+        if(q->type == JOURNAL_DEL_ROW){
+            p->type = -1;
+            return 1;
+        }
+        if(q->type == JOURNAL_INSERT_STR && q->pos <= p->len){
+            char *d = malloc(p->len + q->len);
+            memcpy(d, p->data, q->pos);
+            memcpy(d + q->pos, q->data, q->len);
+            memcpy(d + q->pos + q->len, p->data + q->pos, p->len - q->pos);
+            free(*scratch);
+            *scratch = p->data = d;
+            p->len += q->len;
+            return 1;
+        }
+        if(q->type == JOURNAL_DEL_RANGE && q->pos + q->len <= p->len){
+            memmove(p->data + q->pos, p->data + q->pos + q->len, p->len - q->pos - q->len);
+            p->len -= q->len;
+            return 1;
+        }
+        return 0;
+    }
+    if(p->type == JOURNAL_INSERT_STR && q->row == p->row){
+        //typing extends the inserted run, backspacing inside it shortens it
+        if(q->type == JOURNAL_INSERT_STR && q->pos == p->pos + p->len){
+            char *d = malloc(p->len + q->len);
+            memcpy(d, p->data, p->len);
+            memcpy(d + p->len, q->data, q->len);
+            free(*scratch);
+            *scratch = p->data = d;
+            p->len += q->len;
+            return 1;
+        }
+        if(q->type == JOURNAL_DEL_RANGE && q->pos >= p->pos && q->pos + q->len <= p->pos + p->len){
+            uint32_t at = q->pos - p->pos;
+            memmove(p->data + at, p->data + at + q->len, p->len - at - q->len);
+            p->len -= q->len;
+            return 1;
+        }
+        return 0;
+    }
+    if(p->type == JOURNAL_DEL_RANGE && q->type == JOURNAL_DEL_RANGE && q->row == p->row){
+        //repeated delete keys remove from the same position, repeated backspaces walk left
+        if(q->pos == p->pos){
+            p->len += q->len;
+            return 1;
+        }
+        if(q->pos + q->len == p->pos){
+            p->pos = q->pos;
+            p->len += q->len;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int journalOpIsNoop(struct journalOp *op){
+    //an inserted row that was deleted again, or an insertion or deletion of nothing
+    if(op->type == -1)
+        return 1;
+    return (op->type == JOURNAL_INSERT_STR || op->type == JOURNAL_DEL_RANGE) && op->len == 0;
+}
+
+static void *journalCompactWorker(void *arg){
+    //rewrites the first compactupto bytes of the swap file into tmppath with runs of edits merged
+    (void)arg;
+    size_t len;
+    char *in = readFile(journal.path, &len);
+    int ok = 0;
+    if(in && len >= JOURNAL_HEADER_SIZE){
+        if(len > (size_t)journal.compactupto)
+            len = journal.compactupto;
+        //the header is carried over unchanged
+        size_t outlen = JOURNAL_HEADER_SIZE, outcap = JOURNAL_HEADER_SIZE;
+        char *out = malloc(outcap);
+        memcpy(out, in, JOURNAL_HEADER_SIZE);
+
+        size_t off = JOURNAL_HEADER_SIZE;
+        struct journalOp p = {0}, q;
+        char *scratch = NULL;
+        int havep = 0;
+        while(journalParse(in, len, &off, &q)){
+            if(havep && !journalOpIsNoop(&p) && journalCoalesce(&p, &q, &scratch))
+                continue;
+            if(havep && !journalOpIsNoop(&p))
+                journalAppendRecord(&out, &outlen, &outcap, p.type, p.row, p.pos, p.data, p.len);
+            //q's data points into the input, so it only has to be copied once it is rewritten
+            p = q;
+            free(scratch);
+            scratch = NULL;
+            if(p.type == JOURNAL_INSERT_ROW || p.type == JOURNAL_INSERT_STR){
+                scratch = malloc(p.len ? p.len : 1);
+                memcpy(scratch, p.data, p.len);
+                p.data = scratch;
+            }
+            havep = 1;
+        }
+        if(havep && !journalOpIsNoop(&p))
+            journalAppendRecord(&out, &outlen, &outcap, p.type, p.row, p.pos, p.data, p.len);
+        free(scratch);
+
+        int fd = open(journal.tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if(fd != -1){
+            ok = writeAll(fd, out, outlen) == 0 && fsync(fd) == 0;
+            close(fd);
+        }
+        free(out);
+    }
+    free(in);
+
+    pthread_mutex_lock(&journal.lock);
+    journal.compactok = ok;
+    journal.compactdone = 1;
+    pthread_mutex_unlock(&journal.lock);
+    return NULL;
+}
+
+static void journalFinishCompaction(){
+    //runs on the main thread once the worker is done: the records appended since it started are carried over and the new file replaces the old one
+    pthread_mutex_lock(&journal.lock);
+    int done = journal.compactdone, ok = journal.compactok;
+    pthread_mutex_unlock(&journal.lock);
+    if(!done)
+        return;
+    pthread_join(journal.thread, NULL);
+    journal.compacting = 0;
+
+    journalFlush(0);
+    int fd = ok ? open(journal.tmppath, O_RDWR | O_APPEND) : -1;
+    if(fd != -1){
+        char buf[65536];
+        off_t off = journal.compactupto;
+        ssize_t n;
+        while((n = pread(journal.fd, buf, sizeof(buf), off)) > 0){
+            if(writeAll(fd, buf, n) == -1)
+                break;
+            off += n;
+        }
+        if(n == 0 && fsync(fd) == 0 && rename(journal.tmppath, journal.path) == 0){
+            close(journal.fd);
+            journal.fd = fd;
+            journal.filesize = lseek(fd, 0, SEEK_END);
+            journal.compactedsize = journal.filesize;
+            journal.unsynced = 0;
+            free(journal.tmppath);
+            journal.tmppath = NULL;
+            return;
+        }
+        close(fd);
+    }
+    //the old swap file is still complete, so a failed compaction only costs disk space
+    unlink(journal.tmppath);
+    free(journal.tmppath);
+    journal.tmppath = NULL;
+    journal.compactedsize = journal.filesize;
+}
+
+static void journalStartCompaction(){
+    journalFlush(1);
+    size_t len = strlen(journal.path) + 5;
+    journal.tmppath = malloc(len);
+    snprintf(journal.tmppath, len, "%s.tmp", journal.path);
+    journal.compactupto = journal.filesize;
+    journal.compactdone = 0;
+    journal.compactok = 0;
+    if(pthread_create(&journal.thread, NULL, journalCompactWorker, NULL) == 0){
+        journal.compacting = 1;
+    }
+    else{
+        free(journal.tmppath);
+        journal.tmppath = NULL;
+        journal.compactedsize = journal.filesize;
+    }
+}
+
+void journalIdle(){
+    //called whenever editorReadKey times out waiting for a key
+    if(journal_hangup){
+        journalFlush(1);
+        //the terminal is gone, so exit handlers restoring it would only fail, the swap file is already synced
+        _exit(1);
+    }
+    if(journal.fd == -1)
+        return;
+    if(journal.compacting)
+        journalFinishCompaction();
+    if((journal.len || journal.unsynced) && journalNowMs() - journal.lastop >= JOURNAL_IDLE_MS)
+        journalFlush(1);
+    if(!journal.compacting && journal.filesize > JOURNAL_COMPACT_BYTES && journal.filesize > 2 * journal.compactedsize)
+        journalStartCompaction();
+}
+
+/*** recovery ***/
+
+int journalCheck(const char *filename){
+    //returns 1 if filename has a swap file with edits that apply to it, -1 if it has one for a different version of the file, 0 otherwise
+    char *path = journalPath(filename);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if(fd == -1)
+        return 0;
+    char hdr[JOURNAL_HEADER_SIZE], want[JOURNAL_HEADER_SIZE];
+    struct stat st;
+    int ok = read(fd, hdr, sizeof(hdr)) == sizeof(hdr) && fstat(fd, &st) == 0;
+    close(fd);
+    if(!ok)
+        return 0;
+    if(st.st_size <= JOURNAL_HEADER_SIZE)
+        return 0;
+    journalHeader(want, filename);
+    return memcmp(hdr, want, sizeof(hdr)) == 0 ? 1 : -1;
+}
+
+//while a swap file is replayed the rows are kept with a gap at the row edited last, rows [0, gs) come before it and [ge, cap) after it
+//moving the gap costs the distance between two edits, so typing that stays in one place doesn't move every row below it once per record
+struct journalGap{
+    erow *rows;
+    int cap;
+    int gs;
+    int ge;
+    int numrows;
+};
+
+static erow *journalGapRow(struct journalGap *g, int y){
+    return &g->rows[y < g->gs ? y : y + g->ge - g->gs];
+}
+
+static void journalGapMove(struct journalGap *g, int at){
+    //moves the gap to just before row at
+    if(at < g->gs){
+        int n = g->gs - at;
+        memmove(&g->rows[g->ge - n], &g->rows[at], sizeof(erow) * n);
+        g->gs -= n;
+        g->ge -= n;
+    }
+    else if(at > g->gs){
+        int n = at - g->gs;
+        memmove(&g->rows[g->gs], &g->rows[g->ge], sizeof(erow) * n);
+        g->gs += n;
+        g->ge += n;
+    }
+}
+
+static void journalGapInsert(struct journalGap *g, int at, const char *s, uint32_t len){
+    journalGapMove(g, at);
+    if(g->gs == g->ge){
+        //the gap grows by the size of the buffer when it fills up, the rows after it move to the end of the new allocation
+        int grow = g->cap + 1024;
+        g->rows = realloc(g->rows, sizeof(erow) * (g->cap + grow));
+        memmove(&g->rows[g->ge + grow], &g->rows[g->ge], sizeof(erow) * (g->cap - g->ge));
+        g->ge += grow;
+        g->cap += grow;
+    }
+    erow *row = &g->rows[g->gs++];
+    row->size = len;
+    row->chars = malloc(len + 1);
+    memcpy(row->chars, s, len);
+    row->chars[len] = '\0';
+    row->rsize = 0;
+    row->render = NULL;
+    row->fields = NULL;
+    row->numfields = 0;
+    row->block = -1;
+    editorUpdateRow(row);
+    g->numrows++;
+}
+
+static void journalGapDelete(struct journalGap *g, int at){
+    journalGapMove(g, at);
+    editorFreeRow(&g->rows[g->ge++]);
+    g->numrows--;
+}
+
+int journalReplay(const char *filename){
+    //applies every record in the swap file to the rows loaded from filename, returns the number of records applied
+    //this runs right after loading, before anything else keeps row numbers, so the row hooks are not called
+    char *path = journalPath(filename);
+    size_t len;
+    char *buf = readFile(path, &len);
+    free(path);
+    if(!buf)
+        return -1;
+
+    int count = 0;
+    size_t off = JOURNAL_HEADER_SIZE;
+    struct journalOp op;
+    struct journalGap g = {e.row, e.numrows, e.numrows, e.numrows, e.numrows};
+    journalSuspend(1);
+    while(journalParse(buf, len, &off, &op)){
+        //records that don't fit the buffer can only come from a damaged file, replay stops there
+        if(op.type == JOURNAL_INSERT_ROW){
+            if(op.row > (uint32_t)g.numrows)
+                break;
+            journalGapInsert(&g, op.row, op.data, op.len);
+            e.dirty++;
+        }
+        else if(op.row >= (uint32_t)g.numrows){
+            break;
+        }
+        else if(op.type == JOURNAL_DEL_ROW){
+            journalGapDelete(&g, op.row);
+            e.dirty++;
+        }
+        else if(op.type == JOURNAL_INSERT_STR){
+            editorRowInsertString(journalGapRow(&g, op.row), op.pos, op.data, op.len);
+        }
+        else if(op.type == JOURNAL_DEL_RANGE){
+            editorRowDelRange(journalGapRow(&g, op.row), op.pos, op.len);
+        }
+        else{
+            break;
+        }
+        count++;
+    }
+    //closing the gap at the end leaves the rows in order again
+    journalGapMove(&g, g.numrows);
+    e.row = g.rows;
+    e.numrows = g.numrows;
+    journalSuspend(0);
+    free(buf);
+    return count;
+}
+
+void journalOpenFile(const char *filename){
+    //called once filename has been loaded, offers to recover a previous session's edits and then starts journaling new ones
+    int state = journalCheck(filename);
+    int keep = 0;
+    if(state == 1 && editorConfirm("Unsaved changes to this file were found in its swap file. Recover them?")){
+        double t0 = journalNowMs();
+        int n = journalReplay(filename);
+        editorSetStatusMessage("Recovered %d edits in %.0f ms", n, journalNowMs() - t0);
+        keep = 1;
+    }
+    else if(state == -1){
+        //the file changed since the swap file was written, replaying it would garble the buffer so it is set aside instead
+        char *path = journalPath(filename);
+        size_t len = strlen(path) + 5;
+        char *old = malloc(len);
+        snprintf(old, len, "%s.old", path);
+        rename(path, old);
+        editorSetStatusMessage("Swap file is for another version of this file, moved to %s", old);
+        free(old);
+        free(path);
+    }
+    journalStart(filename, keep);
+}
@@ -0,0 +1,26 @@
+/*** includes ***/
+
+#include "editor.h"
+
+/*** main ***/
+
+int main(int argc, char *argv[]){
+
+    enableRawMode();
+    initEditor();
+    profileInit();
+    journalInstallSignals();
+    if(argc >= 2){
+        editorOpen(argv[1]);
+    }
+
+    editorSetStatusMessage("HELP: Ctrl - S = save | Ctrl - Q = quit | Ctrl - F = find | Ctrl - R = replace");
+
+    while(1){
+        //a burst of keys is drawn as one frame
+        if(editorFrameDue())
+            editorRefreshScreen();
+        editorProcessKeypress();
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<math.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+
+/*** data ***/
+
+//every sample is kept in a histogram for the dump, and the last PROFILE_WINDOW samples in a ring for the rolling percentiles
+struct profileMetric{
+    const char *name;
+    const char *unit;
+    double ring[PROFILE_WINDOW];
+    int ringlen;
+    int ringpos;
+    unsigned long hist[PROFILE_BUCKETS];
+    unsigned long count;
+    double total;
+    double max;
+};
+
+static struct profileMetric metrics[PROFILE_METRICS] = {
+    [PROF_READ] = {.name = "read", .unit = "us"},
+    [PROF_PROCESS] = {.name = "process", .unit = "us"},
+    [PROF_SCROLL] = {.name = "scroll", .unit = "us"},
+    [PROF_DRAW] = {.name = "draw", .unit = "us"},
+    [PROF_WRITE] = {.name = "write", .unit = "us"},
+    [PROF_IDLE] = {.name = "idle", .unit = "us"},
+    [PROF_ALLOCS] = {.name = "allocs", .unit = "calls/frame"},
+    [PROF_ALLOC_BYTES] = {.name = "alloc_bytes", .unit = "bytes/frame"},
+    [PROF_FRAME_BYTES] = {.name = "frame_bytes", .unit = "bytes/frame"},
+};
+
+int profile_enabled = 0;
+static int profile_dump_registered = 0;
+static double stage_start[PROF_STAGES];
+//allocations made since the last frame was written
+static unsigned long frame_allocs;
+static unsigned long frame_alloc_bytes;
+
+/*** profiler ***/
+
+static double profileNowUs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int profileBucket(double v){
+    //four buckets per power of two, so the histogram covers everything from 1 to 2^(PROFILE_BUCKETS/4) with a 19% resolution
+    int b = v < 1 ? 0 : (int)(4 * log2(v)) + 1;
+    return b >= PROFILE_BUCKETS ? PROFILE_BUCKETS - 1 : b;
+}
+
+static double profileBucketLow(int b){
+    return b == 0 ? 0 : pow(2, (b - 1) / 4.0);
+}
+
+static void profileRecord(int metric, double v){
+    struct profileMetric *m = &metrics[metric];
+    m->ring[m->ringpos] = v;
+    m->ringpos = (m->ringpos + 1) % PROFILE_WINDOW;
+    if(m->ringlen < PROFILE_WINDOW)
+        m->ringlen++;
+    m->hist[profileBucket(v)]++;
+    m->count++;
+    m->total += v;
+    if(v > m->max)
+        m->max = v;
+}
+
+static int cmpDouble(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void profilePercentiles(int metric, double *p50, double *p99){
+    struct profileMetric *m = &metrics[metric];
+    double sorted[PROFILE_WINDOW];
+    if(m->ringlen == 0){
+        *p50 = *p99 = 0;
+        return;
+    }
+    memcpy(sorted, m->ring, sizeof(double) * m->ringlen);
+    qsort(sorted, m->ringlen, sizeof(double), cmpDouble);
+    *p50 = sorted[(m->ringlen - 1) / 2];
+    *p99 = sorted[(int)((m->ringlen - 1) * 0.99)];
+}
+
+void profileInit(){
+    //EDITOR_PROFILE=1 turns the profiler on from the start, it can also be toggled with ctrl + p
+    const char *env = getenv("EDITOR_PROFILE");
+    if(env && *env && strcmp(env, "0") != 0)
+        profileToggle();
+}
+
+void profileToggle(){
+    profile_enabled = !profile_enabled;
+    if(profile_enabled && !profile_dump_registered){
+        //once profiling has been used, the full histogram is written out when the editor exits
+        atexit(profileDumpAtExit);
+        profile_dump_registered = 1;
+    }
+    //a stage that is already running when the profiler is switched on is timed from the switch instead of from an unset start
+    int i;
+    double now = profileNowUs();
+    for(i = 0; i < PROF_STAGES; i++)
+        stage_start[i] = now;
+    frame_allocs = 0;
+    frame_alloc_bytes = 0;
+}
+
+void profileBegin(int stage){
+    if(profile_enabled)
+        stage_start[stage] = profileNowUs();
+}
+
+void profileEnd(int stage){
+    if(!profile_enabled)
+        return;
+    double t = profileNowUs() - stage_start[stage];
+    profileRecord(stage, t);
+    //background work runs while a key is awaited, it is timed on its own and left out of the read stage
+    if(stage == PROF_IDLE)
+        stage_start[PROF_READ] += t;
+}
+
+void profileFrame(size_t bytes){
+    if(!profile_enabled)
+        return;
+    profileRecord(PROF_ALLOCS, frame_allocs);
+    profileRecord(PROF_ALLOC_BYTES, frame_alloc_bytes);
+    profileRecord(PROF_FRAME_BYTES, bytes);
+    frame_allocs = 0;
+    frame_alloc_bytes = 0;
+}
+
+static void profileCountAlloc(size_t size){
+    //worker threads allocate too, so the counters are bumped atomically
+    if(profile_enabled){
+        __atomic_fetch_add(&frame_allocs, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&frame_alloc_bytes, size, __ATOMIC_RELAXED);
+    }
+}
+
+void *profileMalloc(size_t size){
+    profileCountAlloc(size);
+    return malloc(size);
+}
+
+void *profileCalloc(size_t n, size_t size){
+    profileCountAlloc(n * size);
+    return calloc(n, size);
+}
+
+void *profileRealloc(void *ptr, size_t size){
+    profileCountAlloc(size);
+    return realloc(ptr, size);
+}
+
+char *profileStrdup(const char *s){
+    profileCountAlloc(strlen(s) + 1);
+    return strdup(s);
+}
+
+char *profileStrndup(const char *s, size_t n){
+    profileCountAlloc(strnlen(s, n) + 1);
+    return strndup(s, n);
+}
+
+int profileStatus(char *buf, size_t len){
+    //rolling p50/p99 of the last PROFILE_WINDOW samples, short enough to fit in the status bar
+    static const struct{
+        int metric;
+        const char *label;
+    }shown[] = {
+        {PROF_READ, "rd"},
+        {PROF_IDLE, "idle"},
+        {PROF_PROCESS, "key"},
+        {PROF_SCROLL, "scr"},
+        {PROF_DRAW, "draw"},
+        {PROF_WRITE, "wr"},
+        {PROF_ALLOCS, "alloc"},
+        {PROF_FRAME_BYTES, "out"},
+    };
+    size_t used = 0;
+    size_t i;
+    for(i = 0; i < sizeof(shown) / sizeof(shown[0]) && used < len; i++){
+        double p50, p99;
+        profilePercentiles(shown[i].metric, &p50, &p99);
+        int n = snprintf(buf + used, len - used, "%s%s %.0f/%.0f", i ? " " : "", shown[i].label, p50, p99);
+        if(n < 0)
+            break;
+        used += n;
+    }
+    return used < len ? (int)used : (int)len - 1;
+}
+
+void profileDump(const char *path){
+    FILE *fp = fopen(path, "w");
+    if(!fp)
+        return;
+    int i, b;
+    //a summary line per metric, then one line per non-empty histogram bucket
+    fprintf(fp, "# metric unit count mean max p50 p99 (last %d)\n", PROFILE_WINDOW);
+    for(i = 0; i < PROFILE_METRICS; i++){
+        struct profileMetric *m = &metrics[i];
+        double p50, p99;
+        profilePercentiles(i, &p50, &p99);
+        fprintf(fp, "summary %s %s %lu %.2f %.2f %.2f %.2f\n", m->name, m->unit, m->count, m->count ? m->total / m->count : 0, m->max, p50, p99);
+    }
+    fprintf(fp, "# metric unit bucket_low bucket_high count\n");
+    for(i = 0; i < PROFILE_METRICS; i++){
+        struct profileMetric *m = &metrics[i];
+        for(b = 0; b < PROFILE_BUCKETS; b++){
+            if(m->hist[b])
+                fprintf(fp, "hist %s %s %.2f %.2f %lu\n", m->name, m->unit, profileBucketLow(b), profileBucketLow(b + 1), m->hist[b]);
+        }
+    }
+    fclose(fp);
+}
+
+void profileDumpAtExit(){
+    //EDITOR_PROFILE_FILE picks where the histogram goes, by default it lands next to where the editor was started
+    const char *path = getenv("EDITOR_PROFILE_FILE");
+    profileDump(path && *path ? path : "editor-profile.txt");
+}
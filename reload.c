@@ -0,0 +1,542 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<fcntl.h>
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include "alloc.h"
+
+/*** data ***/
+
+//a run of lines [a0, a1) of one version replaced by [b0, b1) of another
+struct hunk{
+    int a0, a1;
+    int b0, b1;
+};
+
+//the file as it was on disk when it was last opened or saved: its identity, and a hash per line to diff against
+static struct{
+    int tracked;
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t *hash;
+    int numlines;
+    //set once a change that could not be merged has been reported, so it is not reported every second
+    int reported;
+    time_t lastcheck;
+}disk = {0};
+
+//more differing lines than this are not worth diffing, the file is read again from scratch instead
+#define RELOAD_MAX_EDITS 2000
+//how often the idle loop looks at the file
+#define RELOAD_CHECK_INTERVAL 1
+
+/*** hashing ***/
+
+static uint64_t reloadHashLine(const char *s, size_t len){
+    //a multiply-xorshift hash taken eight bytes at a time, lines are compared by hash only
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    while(len >= 8){
+        uint64_t w;
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        s += 8;
+        len -= 8;
+    }
+    uint64_t w = 0;
+    memcpy(&w, s, len);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+static uint64_t *reloadHashRows(){
+    uint64_t *hash = malloc(sizeof(uint64_t) * (e.numrows ? e.numrows : 1));
+    int i;
+    for(i = 0; i < e.numrows; i++)
+        hash[i] = reloadHashLine(e.row[i].chars, e.row[i].size);
+    return hash;
+}
+
+/*** diff ***/
+
+static int diffHunks(const uint64_t *a, int n, const uint64_t *b, int m, struct hunk **out){
+    //Myers' O((n + m) d) diff on line hashes, returns the number of hunks or -1 when more than RELOAD_MAX_EDITS lines differ
+    //the common head and tail are skipped first, which is all the work there is for a single edited region
+    int pre = 0, suf = 0;
+    while(pre < n && pre < m && a[pre] == b[pre])
+        pre++;
+    while(suf < n - pre && suf < m - pre && a[n - 1 - suf] == b[m - 1 - suf])
+        suf++;
+    a += pre;
+    b += pre;
+    n -= pre + suf;
+    m -= pre + suf;
+
+    *out = NULL;
+    if(n == 0 && m == 0)
+        return 0;
+    if(n == 0 || m == 0){
+        *out = malloc(sizeof(struct hunk));
+        (*out)[0] = (struct hunk){pre, pre + n, pre, pre + m};
+        return 1;
+    }
+
+    //trace[d] holds the furthest x reached on every diagonal k = x - y in [-d, d] after d edits
+    int maxd = n + m < RELOAD_MAX_EDITS ? n + m : RELOAD_MAX_EDITS;
+    int **trace = calloc(maxd + 1, sizeof(int *));
+    int d, k, found = -1;
+    for(d = 0; d <= maxd && found == -1; d++){
+        int *v = malloc(sizeof(int) * (2 * d + 1));
+        int *prev = d ? trace[d - 1] : NULL;
+        trace[d] = v;
+        for(k = -d; k <= d; k += 2){
+            int x;
+            if(d == 0)
+                x = 0;
+            else if(k == -d || (k != d && prev[k - 1 + d - 1] < prev[k + 1 + d - 1]))
+                x = prev[k + 1 + d - 1];
+            else
+                x = prev[k - 1 + d - 1] + 1;
+            int y = x - k;
+            while(x < n && y < m && a[x] == b[y])
+                x++, y++;
+            v[k + d] = x;
+            if(x >= n && y >= m){
+                found = d;
+                break;
+            }
+        }
+    }
+    if(found == -1){
+        for(d = 0; d <= maxd; d++)
+            free(trace[d]);
+        free(trace);
+        return -1;
+    }
+
+    //walking back from (n, m) gives the edits last to first, each one a deleted line of a or an inserted line of b
+    int *ex = malloc(sizeof(int) * (found + 1));
+    int *ey = malloc(sizeof(int) * (found + 1));
+    char *del = malloc(found + 1);
+    int x = n, y = m;
+    for(d = found; d > 0; d--){
+        int *prev = trace[d - 1];
+        k = x - y;
+        int pk;
+        if(k == -d || (k != d && prev[k - 1 + d - 1] < prev[k + 1 + d - 1]))
+            pk = k + 1;
+        else
+            pk = k - 1;
+        int px = prev[pk + d - 1];
+        int py = px - pk;
+        ex[d - 1] = px;
+        ey[d - 1] = py;
+        del[d - 1] = pk == k - 1;
+        x = px;
+        y = py;
+    }
+    for(d = 0; d <= found; d++)
+        free(trace[d]);
+    free(trace);
+
+    //edits that follow each other without a common line in between make up one hunk
+    struct hunk *hunks = malloc(sizeof(struct hunk) * (found ? found : 1));
+    int nh = 0;
+    for(d = 0; d < found; d++){
+        int ax = ex[d], by = ey[d];
+        if(nh > 0 && hunks[nh - 1].a1 == pre + ax && hunks[nh - 1].b1 == pre + by){
+            if(del[d])
+                hunks[nh - 1].a1++;
+            else
+                hunks[nh - 1].b1++;
+            continue;
+        }
+        hunks[nh++] = (struct hunk){pre + ax, pre + ax + del[d], pre + by, pre + by + !del[d]};
+    }
+    free(ex);
+    free(ey);
+    free(del);
+    *out = hunks;
+    return nh;
+}
+
+/*** tracking ***/
+
+static void reloadStat(const struct stat *st){
+    disk.dev = st->st_dev;
+    disk.ino = st->st_ino;
+    disk.size = st->st_size;
+    disk.mtime = st->st_mtim;
+}
+
+static int reloadStatChanged(const struct stat *st){
+    return st->st_dev != disk.dev || st->st_ino != disk.ino || st->st_size != disk.size ||
+        st->st_mtim.tv_sec != disk.mtime.tv_sec || st->st_mtim.tv_nsec != disk.mtime.tv_nsec;
+}
+
+void reloadForget(){
+    free(disk.hash);
+    free(disk.path);
+    disk.hash = NULL;
+    disk.path = NULL;
+    disk.numlines = 0;
+    disk.tracked = 0;
+    disk.reported = 0;
+}
+
+void reloadTrack(const char *filename){
+    //remembers the file as the buffer holds it now, called right after it has been loaded or saved
+    struct stat st;
+    reloadForget();
+    if(!filename || stat(filename, &st) == -1 || !S_ISREG(st.st_mode))
+        return;
+    reloadStat(&st);
+    disk.path = strdup(filename);
+    //compressed files are only watched, reloading one would mean decoding it all again
+    if(e.compression == COMPRESS_NONE){
+        disk.hash = reloadHashRows();
+        disk.numlines = e.numrows;
+    }
+    disk.tracked = 1;
+}
+
+int reloadStamp(off_t *size, struct timespec *mtime, uint64_t *hash){
+    //identifies the file as it was when it was last loaded or saved, 0 when its lines were not hashed
+    int i;
+    if(!disk.tracked || !disk.hash)
+        return 0;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ disk.numlines;
+    for(i = 0; i < disk.numlines; i++){
+        h = (h ^ disk.hash[i]) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    *size = disk.size;
+    *mtime = disk.mtime;
+    *hash = h;
+    return 1;
+}
+
+/*** reload ***/
+
+//the new version of the file, mapped, with where each of its lines starts
+struct newFile{
+    char *map;
+    size_t len;
+    size_t *start;
+    uint64_t *hash;
+    int numlines;
+};
+
+static int reloadReadFile(const char *filename, struct newFile *nf, struct stat *st){
+    int fd = open(filename, O_RDONLY);
+    if(fd == -1)
+        return -1;
+    if(fstat(fd, st) == -1){
+        close(fd);
+        return -1;
+    }
+    nf->len = st->st_size;
+    nf->map = NULL;
+    if(nf->len > 0){
+        nf->map = mmap(NULL, nf->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(nf->map == MAP_FAILED){
+            close(fd);
+            return -1;
+        }
+        madvise(nf->map, nf->len, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    //lines are split the way editorOpen splits them
+    size_t cap = 1024;
+    nf->start = malloc(sizeof(size_t) * (cap + 1));
+    nf->hash = malloc(sizeof(uint64_t) * cap);
+    nf->numlines = 0;
+    char *p = nf->map, *end = nf->map + nf->len;
+    while(p < end){
+        char *nl = memchr(p, '\n', end - p);
+        char *next = nl ? nl + 1 : end;
+        char *lineend = nl ? nl : end;
+        while(lineend > p && (lineend[-1] == '\n' || lineend[-1] == '\r'))
+            lineend--;
+        if((size_t)nf->numlines == cap){
+            cap *= 2;
+            nf->start = realloc(nf->start, sizeof(size_t) * (cap + 1));
+            nf->hash = realloc(nf->hash, sizeof(uint64_t) * cap);
+        }
+        nf->start[nf->numlines] = p - nf->map;
+        nf->hash[nf->numlines] = reloadHashLine(p, lineend - p);
+        nf->numlines++;
+        p = next;
+    }
+    nf->start[nf->numlines] = nf->len;
+    return 0;
+}
+
+static void reloadLine(const struct newFile *nf, int i, char **s, size_t *len){
+    char *p = nf->map + nf->start[i];
+    char *lineend = nf->map + nf->start[i + 1];
+    while(lineend > p && (lineend[-1] == '\n' || lineend[-1] == '\r'))
+        lineend--;
+    *s = p;
+    *len = lineend - p;
+}
+
+static void reloadFreeFile(struct newFile *nf){
+    if(nf->map)
+        munmap(nf->map, nf->len);
+    free(nf->start);
+    free(nf->hash);
+}
+
+static int reloadShiftRow(int y, const struct hunk *h){
+    //where row y ends up once buffer rows [a0, a1) are replaced by b1 - b0 new ones
+    int added = h->b1 - h->b0;
+    if(y >= h->a1)
+        return y + added - (h->a1 - h->a0);
+    if(y >= h->a0)
+        return h->a0 + (y - h->a0 < added ? y - h->a0 : (added ? added - 1 : 0));
+    return y;
+}
+
+static void reloadApply(struct hunk *apply, int n, const struct newFile *nf){
+    //apply[i] replaces buffer rows [a0, a1) by lines [b0, b1) of the new file, in one pass over the row array
+    int i, j;
+    int newrows = e.numrows;
+    for(i = 0; i < n; i++)
+        newrows += (apply[i].b1 - apply[i].b0) - (apply[i].a1 - apply[i].a0);
+
+    erow *rows = malloc(sizeof(erow) * (newrows ? newrows : 1));
+    int src = 0, out = 0;
+    for(i = 0; i < n; i++){
+        memcpy(&rows[out], &e.row[src], sizeof(erow) * (apply[i].a0 - src));
+        out += apply[i].a0 - src;
+        for(j = apply[i].a0; j < apply[i].a1; j++)
+            editorFreeRow(&e.row[j]);
+        for(j = apply[i].b0; j < apply[i].b1; j++){
+            char *s;
+            size_t len;
+            reloadLine(nf, j, &s, &len);
+            erow *row = &rows[out++];
+            row->size = len;
+            row->chars = malloc(len + 1);
+            memcpy(row->chars, s, len);
+            row->chars[len] = '\0';
+            row->rsize = 0;
+            row->render = NULL;
+            row->fields = NULL;
+            row->numfields = 0;
+            row->block = -1;
+            editorUpdateRow(row);
+        }
+        src = apply[i].a1;
+    }
+    memcpy(&rows[out], &e.row[src], sizeof(erow) * (e.numrows - src));
+    free(e.row);
+    e.row = rows;
+    e.numrows = newrows;
+
+    //the cursor and the scroll position follow the text around them, last hunk first so the earlier rows are still where the hunks say
+    for(i = n - 1; i >= 0; i--){
+        e.cy = reloadShiftRow(e.cy, &apply[i]);
+        e.rowoff = reloadShiftRow(e.rowoff, &apply[i]);
+    }
+    //the hooks are told first hunk first, shifted by the hunks before it, so the rows they are given are where they now are in e.row
+    int shift = 0;
+    for(i = 0; i < n; i++){
+        int at = apply[i].a0 + shift;
+        if(apply[i].a1 > apply[i].a0)
+            editorRowsDeleted(at, apply[i].a1 - apply[i].a0);
+        if(apply[i].b1 > apply[i].b0)
+            editorRowsInserted(at, apply[i].b1 - apply[i].b0);
+        shift += (apply[i].b1 - apply[i].b0) - (apply[i].a1 - apply[i].a0);
+    }
+    if(e.cy > e.numrows)
+        e.cy = e.numrows;
+    if(e.cy < e.numrows && e.cx > e.row[e.cy].size)
+        e.cx = e.row[e.cy].size;
+    //row numbers held by the replace-all undo no longer mean the same rows
+    replaceForget();
+}
+
+static int reloadConflict(const struct hunk *r, const struct hunk *l){
+    //two hunks of the same base overlap, or insert at the same place
+    if(r->a0 < l->a1 && l->a0 < r->a1)
+        return 1;
+    return (r->a0 == r->a1 || l->a0 == l->a1) && r->a0 <= l->a1 && l->a0 <= r->a1;
+}
+
+static void reloadJournal(){
+    //the swap file describes edits on top of the file on disk, so it starts over from the new version
+    //with unsaved edits left, the difference between the new file and the buffer is journaled as row operations
+    journalStop(1);
+    journalStart(e.filename, 0);
+    if(!e.dirty)
+        return;
+    uint64_t *hash = reloadHashRows();
+    struct hunk *h;
+    int n = diffHunks(disk.hash, disk.numlines, hash, e.numrows, &h);
+    int i, j;
+    if(n == -1){
+        //too far apart to describe row by row, so the swap file gets the whole buffer
+        for(j = disk.numlines - 1; j >= 0; j--)
+            journalRecord(JOURNAL_DEL_ROW, j, 0, NULL, 0);
+        for(j = 0; j < e.numrows; j++)
+            journalRecord(JOURNAL_INSERT_ROW, j, 0, e.row[j].chars, e.row[j].size);
+    }
+    for(i = n - 1; i >= 0; i--){
+        for(j = h[i].a1 - 1; j >= h[i].a0; j--)
+            journalRecord(JOURNAL_DEL_ROW, h[i].a0, 0, NULL, 0);
+        for(j = h[i].b0; j < h[i].b1; j++)
+            journalRecord(JOURNAL_INSERT_ROW, h[i].a0 + j - h[i].b0, 0, e.row[j].chars, e.row[j].size);
+    }
+    free(h);
+    free(hash);
+}
+
+static void reloadFromScratch(const struct newFile *nf){
+    //the new file has little in common with the buffer, every row is replaced
+    struct hunk all = {0, e.numrows, 0, nf->numlines};
+    int cy = e.cy, rowoff = e.rowoff;
+    reloadApply(&all, 1, nf);
+    e.cy = cy < e.numrows ? cy : e.numrows;
+    e.rowoff = rowoff < e.numrows ? rowoff : 0;
+    if(e.cy < e.numrows && e.cx > e.row[e.cy].size)
+        e.cx = e.row[e.cy].size;
+}
+
+int editorReload(){
+    //merges the new version of the file on disk into the buffer, returns the number of hunks that clashed with unsaved edits and were left alone, or -1 when nothing could be merged
+    struct newFile nf;
+    struct stat st;
+    if(!disk.tracked || !disk.hash || reloadReadFile(e.filename, &nf, &st) == -1)
+        return -1;
+
+    //changes between the version last loaded and the one on disk now
+    struct hunk *remote;
+    int nremote = diffHunks(disk.hash, disk.numlines, nf.hash, nf.numlines, &remote);
+    int conflicts = 0;
+    journalSuspend(1);
+    if(nremote == -1 && e.dirty){
+        journalSuspend(0);
+        reloadFreeFile(&nf);
+        return -1;
+    }
+    if(nremote == -1){
+        reloadFromScratch(&nf);
+    }
+    else if(nremote > 0){
+        //unsaved edits, as changes between the version last loaded and the buffer
+        struct hunk *local = NULL;
+        int nlocal = 0;
+        if(e.dirty){
+            uint64_t *hash = reloadHashRows();
+            nlocal = diffHunks(disk.hash, disk.numlines, hash, e.numrows, &local);
+            free(hash);
+            if(nlocal == -1){
+                journalSuspend(0);
+                free(remote);
+                reloadFreeFile(&nf);
+                return -1;
+            }
+        }
+        //a change on disk is taken unless it touches lines that were edited here, the buffer's row numbers are shifted by the local edits above it
+        struct hunk *apply = malloc(sizeof(struct hunk) * nremote);
+        int napply = 0, i, j = 0, shift = 0;
+        for(i = 0; i < nremote; i++){
+            int clash = 0, t;
+            while(j < nlocal && local[j].a1 <= remote[i].a0 && !reloadConflict(&remote[i], &local[j])){
+                shift += (local[j].b1 - local[j].b0) - (local[j].a1 - local[j].a0);
+                j++;
+            }
+            for(t = j; t < nlocal && local[t].a0 <= remote[i].a1; t++){
+                if(reloadConflict(&remote[i], &local[t]))
+                    clash = 1;
+            }
+            if(clash){
+                conflicts++;
+                continue;
+            }
+            apply[napply++] = (struct hunk){remote[i].a0 + shift, remote[i].a1 + shift, remote[i].b0, remote[i].b1};
+        }
+        if(napply)
+            reloadApply(apply, napply, &nf);
+        free(apply);
+        free(local);
+    }
+    free(remote);
+
+    //the new version is the one later changes on disk are compared with
+    free(disk.hash);
+    disk.hash = nf.hash;
+    disk.numlines = nf.numlines;
+    nf.hash = NULL;
+    reloadStat(&st);
+    disk.reported = 0;
+    journalSuspend(0);
+    reloadJournal();
+    reloadFreeFile(&nf);
+    return conflicts;
+}
+
+int editorCheckDisk(int force){
+    //looks for a change to the file on disk and merges it, returns 0 when the buffer is in step with the file and -1 when it is not
+    //the idle loop calls this at most every RELOAD_CHECK_INTERVAL seconds, force skips that wait
+    struct stat st;
+    //a buffer saved under another name is not compared with the file it came from
+    if(!disk.tracked || !e.filename || strcmp(disk.path, e.filename) != 0)
+        return 0;
+    if(e.modal)
+        return disk.reported ? -1 : 0;
+    time_t now = time(NULL);
+    if(!force && now - disk.lastcheck < RELOAD_CHECK_INTERVAL)
+        return disk.reported ? -1 : 0;
+    disk.lastcheck = now;
+    if(stat(e.filename, &st) == -1){
+        if(!disk.reported)
+            editorSetStatusMessage("%s was deleted or moved on disk", e.filename);
+        disk.reported = 1;
+        return -1;
+    }
+    if(!reloadStatChanged(&st))
+        return disk.reported ? -1 : 0;
+
+    if(e.compression != COMPRESS_NONE || !disk.hash){
+        reloadStat(&st);
+        if(!disk.reported)
+            editorSetStatusMessage("%s changed on disk", e.filename);
+        disk.reported = 1;
+        return -1;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int conflicts = editorReload();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+    if(conflicts == -1){
+        //the buffer stays diffed against the old version, the new one is only tried again when it changes once more
+        reloadStat(&st);
+        if(!disk.reported)
+            editorSetStatusMessage("%s changed on disk and is too different to merge", e.filename);
+        disk.reported = 1;
+        return -1;
+    }
+    if(conflicts > 0){
+        editorSetStatusMessage("Reloaded in %.1f ms, %d changes on disk clash with unsaved edits", ms, conflicts);
+        disk.reported = 1;
+        return -1;
+    }
+    editorSetStatusMessage("%s changed on disk, reloaded in %.1f ms", e.filename, ms);
+    return 0;
+}
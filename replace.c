@@ -0,0 +1,404 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<pthread.h>
+#include<regex.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+
+#include "alloc.h"
+
+/*** data ***/
+
+//a query wrapped in slashes, like /[0-9]+/, is a POSIX extended regular expression, anything else is matched literally
+struct replacePattern{
+    int regex;
+    regex_t re;
+    const char *query;
+    size_t querylen;
+    const char *with;
+    size_t withlen;
+};
+
+//a row rebuilt by replace-all, chars is the new content until it is committed, and the old content afterwards for undo
+struct replaceRow{
+    int row;
+    char *chars;
+    int size;
+};
+
+struct replaceJob{
+    const struct replacePattern *pat;
+    int start, end;
+    struct replaceRow *rows;
+    int numrows;
+    long count;
+};
+
+//rows below this many are not worth a thread of their own
+#define REPLACE_ROWS_PER_THREAD 16384
+#define REPLACE_MAX_THREADS 16
+
+//the rows changed by the last replace-all, ctrl + z puts them back while nothing else has been edited since
+static struct replaceRow *undo_rows = NULL;
+static int undo_numrows = 0;
+static int undo_dirty = -1;
+static int undo_cx, undo_cy;
+
+/*** matching ***/
+
+static int replaceCompile(struct replacePattern *pat, const char *query, const char *with){
+    size_t len = strlen(query);
+    pat->with = with;
+    pat->withlen = strlen(with);
+    pat->regex = len > 2 && query[0] == '/' && query[len - 1] == '/';
+    if(!pat->regex){
+        pat->query = query;
+        pat->querylen = len;
+        return 0;
+    }
+    char *expr = strndup(query + 1, len - 2);
+    int err = regcomp(&pat->re, expr, REG_EXTENDED);
+    free(expr);
+    return err ? -1 : 0;
+}
+
+static void replaceFreePattern(struct replacePattern *pat){
+    if(pat->regex)
+        regfree(&pat->re);
+}
+
+static int replaceMatch(const struct replacePattern *pat, const char *s, int len, int from, regmatch_t *groups){
+    //finds the first match in s[from, len), groups[0] gets its bounds relative to s
+    if(!pat->regex){
+        const char *m = memmem(s + from, len - from, pat->query, pat->querylen);
+        if(!m)
+            return 0;
+        groups[0].rm_so = m - s;
+        groups[0].rm_eo = groups[0].rm_so + pat->querylen;
+        return 1;
+    }
+    if(from > len || regexec(&pat->re, s + from, 10, groups, from > 0 ? REG_NOTBOL : 0) != 0)
+        return 0;
+    int i;
+    for(i = 0; i < 10; i++){
+        if(groups[i].rm_so != -1){
+            groups[i].rm_so += from;
+            groups[i].rm_eo += from;
+        }
+    }
+    return 1;
+}
+
+static int replaceExpand(const struct replacePattern *pat, const char *s, regmatch_t *groups, char *out){
+    //writes the replacement for one match to out (when out is not NULL) and returns its length
+    //with a regex, \0 to \9 stand for the match and its groups and \\ for a backslash
+    if(!pat->regex){
+        if(out)
+            memcpy(out, pat->with, pat->withlen);
+        return pat->withlen;
+    }
+    int n = 0;
+    size_t i;
+    for(i = 0; i < pat->withlen; i++){
+        char c = pat->with[i];
+        if(c == '\\' && i + 1 < pat->withlen){
+            char d = pat->with[++i];
+            if(d >= '0' && d <= '9'){
+                regmatch_t *g = &groups[d - '0'];
+                if(g->rm_so != -1){
+                    if(out)
+                        memcpy(out + n, s + g->rm_so, g->rm_eo - g->rm_so);
+                    n += g->rm_eo - g->rm_so;
+                }
+                continue;
+            }
+            c = d;
+        }
+        if(out)
+            out[n] = c;
+        n++;
+    }
+    return n;
+}
+
+/*** replace all ***/
+
+static int replaceRowInto(const struct replacePattern *pat, erow *row, char **scratch, size_t *scratchcap, int *count){
+    //builds the replaced row in scratch and returns its length, or -1 when nothing matched
+    regmatch_t groups[10];
+    int from = 0, copied = 0, matches = 0, lastend = -1;
+    size_t len = 0;
+    while(from <= row->size && replaceMatch(pat, row->chars, row->size, from, groups)){
+        int so = groups[0].rm_so, eo = groups[0].rm_eo;
+        //like sed, an empty match right after the previous match does not count
+        if(eo == so && so == lastend){
+            from = so + 1;
+            continue;
+        }
+        size_t need = len + (so - copied) + replaceExpand(pat, row->chars, groups, NULL) + (row->size - so) + 1;
+        if(need > *scratchcap){
+            *scratchcap = need * 2;
+            *scratch = realloc(*scratch, *scratchcap);
+        }
+        memcpy(*scratch + len, row->chars + copied, so - copied);
+        len += so - copied;
+        len += replaceExpand(pat, row->chars, groups, *scratch + len);
+        copied = eo;
+        lastend = eo;
+        matches++;
+        //an empty match keeps the next character and moves past it, so x* can not match the same place forever
+        if(eo == so){
+            if(so < row->size)
+                (*scratch)[len++] = row->chars[so];
+            copied = so + 1;
+            from = so + 1;
+        }
+        else
+            from = eo;
+    }
+    if(matches == 0)
+        return -1;
+    if(copied < row->size){
+        memcpy(*scratch + len, row->chars + copied, row->size - copied);
+        len += row->size - copied;
+    }
+    *count += matches;
+    return len;
+}
+
+static void *replaceWorker(void *arg){
+    //rebuilds the changed rows of [start, end) without touching the buffer, the main thread swaps them in afterwards
+    struct replaceJob *job = arg;
+    char *scratch = NULL;
+    size_t scratchcap = 0;
+    int cap = 0, y;
+    for(y = job->start; y < job->end; y++){
+        int matches = 0;
+        int len = replaceRowInto(job->pat, &e.row[y], &scratch, &scratchcap, &matches);
+        if(len < 0)
+            continue;
+        if(job->numrows == cap){
+            cap = cap ? cap * 2 : 64;
+            job->rows = realloc(job->rows, sizeof(struct replaceRow) * cap);
+        }
+        //the one allocation this row gets
+        char *chars = malloc(len + 1);
+        memcpy(chars, scratch, len);
+        chars[len] = '\0';
+        job->rows[job->numrows++] = (struct replaceRow){y, chars, len};
+        job->count += matches;
+    }
+    free(scratch);
+    return NULL;
+}
+
+static void replaceSwapRow(struct replaceRow *r){
+    //puts r's content in the buffer and keeps what was there in r
+    erow *row = &e.row[r->row];
+    char *chars = row->chars;
+    int size = row->size;
+    row->chars = r->chars;
+    row->size = r->size;
+    r->chars = chars;
+    r->size = size;
+    editorUpdateRow(row);
+    journalRecord(JOURNAL_DEL_RANGE, r->row, 0, NULL, size);
+    journalRecord(JOURNAL_INSERT_STR, r->row, 0, row->chars, row->size);
+}
+
+void replaceForget(){
+    int i;
+    for(i = 0; i < undo_numrows; i++)
+        free(undo_rows[i].chars);
+    free(undo_rows);
+    undo_rows = NULL;
+    undo_numrows = 0;
+    undo_dirty = -1;
+}
+
+long editorReplaceAll(const char *query, const char *with, int *rows){
+    //replaces every match in the buffer in one pass, returns the number of matches or -1 for a bad regex
+    struct replacePattern pat;
+    if(replaceCompile(&pat, query, with) == -1)
+        return -1;
+
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads > e.numrows / REPLACE_ROWS_PER_THREAD + 1)
+        nthreads = e.numrows / REPLACE_ROWS_PER_THREAD + 1;
+    if(nthreads > REPLACE_MAX_THREADS)
+        nthreads = REPLACE_MAX_THREADS;
+    if(nthreads < 1)
+        nthreads = 1;
+
+    struct replaceJob jobs[REPLACE_MAX_THREADS];
+    pthread_t threads[REPLACE_MAX_THREADS];
+    int started[REPLACE_MAX_THREADS];
+    int i, j;
+    for(i = 0; i < nthreads; i++){
+        jobs[i] = (struct replaceJob){&pat, (long)e.numrows * i / nthreads, (long)e.numrows * (i + 1) / nthreads, NULL, 0, 0};
+        //the main thread takes the first range itself, and any range a thread could not be started for
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, replaceWorker, &jobs[i]) == 0;
+    }
+    for(i = 0; i < nthreads; i++){
+        if(!started[i])
+            replaceWorker(&jobs[i]);
+    }
+    for(i = 1; i < nthreads; i++){
+        if(started[i])
+            pthread_join(threads[i], NULL);
+    }
+    replaceFreePattern(&pat);
+
+    long count = 0;
+    int changed = 0;
+    for(i = 0; i < nthreads; i++){
+        count += jobs[i].count;
+        changed += jobs[i].numrows;
+    }
+    if(rows)
+        *rows = changed;
+    if(changed == 0){
+        for(i = 0; i < nthreads; i++)
+            free(jobs[i].rows);
+        return 0;
+    }
+
+    //the whole pass is a single undo step, holding the old content of every changed row
+    replaceForget();
+    undo_rows = malloc(sizeof(struct replaceRow) * changed);
+    for(i = 0; i < nthreads; i++){
+        for(j = 0; j < jobs[i].numrows; j++){
+            replaceSwapRow(&jobs[i].rows[j]);
+            undo_rows[undo_numrows++] = jobs[i].rows[j];
+        }
+        free(jobs[i].rows);
+    }
+    undo_cx = e.cx;
+    undo_cy = e.cy;
+    if(e.cy < e.numrows && e.cx > e.row[e.cy].size)
+        e.cx = e.row[e.cy].size;
+    e.dirty++;
+    undo_dirty = e.dirty;
+    return count;
+}
+
+int editorUndo(){
+    //reverts the last replace-all, returns 0 when there is nothing left to undo
+    if(undo_numrows == 0 || e.dirty != undo_dirty){
+        replaceForget();
+        return 0;
+    }
+    int i;
+    for(i = 0; i < undo_numrows; i++)
+        replaceSwapRow(&undo_rows[i]);
+    e.cx = undo_cx;
+    e.cy = undo_cy;
+    e.dirty++;
+    replaceForget();
+    return 1;
+}
+
+/*** prompt ***/
+
+static int replaceNext(const struct replacePattern *pat, int *y, int *x, regmatch_t *groups, int *wrapped){
+    //finds the first match at or after (x, y), going round past the end of the file at most once
+    int i;
+    for(i = 0; i <= e.numrows && e.numrows > 0; i++){
+        int row = *y + i;
+        if(row >= e.numrows){
+            row -= e.numrows;
+            *wrapped = 1;
+        }
+        if(replaceMatch(pat, e.row[row].chars, e.row[row].size, i == 0 ? *x : 0, groups)){
+            *y = row;
+            *x = groups[0].rm_so;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void editorReplace(){
+    //asks for a query and a replacement, then steps through the matches: y replaces one, n skips it, a replaces all of them
+    char *query = editorPrompt("Replace: %s (/regex/ for a regex, ESC to cancel)", NULL);
+    if(!query)
+        return;
+    char *with = editorPromptAllowEmpty("Replace with: %s (ESC to cancel)", NULL);
+    if(!with){
+        free(query);
+        return;
+    }
+    cursorsClear();
+
+    struct replacePattern pat;
+    if(replaceCompile(&pat, query, with) == -1){
+        editorSetStatusMessage("Bad regex: %s", query);
+        free(query);
+        free(with);
+        return;
+    }
+
+    int sy = e.cy < e.numrows ? e.cy : 0;
+    int sx = e.cy < e.numrows ? e.cx : 0;
+    int y = sy, x = sx, wrapped = 0, replaced = 0;
+    regmatch_t groups[10];
+    editorSetStatusMessage("No match for %s", query);
+    while(replaceNext(&pat, &y, &x, groups, &wrapped)){
+        //once the search has come round again, the matches from where it started on have all been offered
+        if(wrapped && (y > sy || (y == sy && x >= sx)))
+            break;
+        e.cy = y;
+        e.cx = x;
+        editorSetStatusMessage("Replace this match? (y)es (n)o (a)ll (q)uit");
+        editorRefreshScreen();
+        e.modal++;
+        int c = editorReadKey();
+        e.modal--;
+        if(c == 'a' || c == 'A'){
+            struct timespec t0, t1;
+            int rows = 0;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            long count = editorReplaceAll(query, with, &rows);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+            editorSetStatusMessage("Replaced %ld in %d rows in %.1f ms, ctrl-z to undo", count + replaced, rows, ms);
+            break;
+        }
+        else if(c == 'y' || c == 'Y'){
+            erow *row = &e.row[y];
+            int len = replaceExpand(&pat, row->chars, groups, NULL);
+            char *text = malloc(len + 1);
+            replaceExpand(&pat, row->chars, groups, text);
+            int mlen = groups[0].rm_eo - groups[0].rm_so;
+            editorRowDelRange(row, x, mlen);
+            editorRowInsertString(row, x, text, len);
+            free(text);
+            if(wrapped && y == sy)
+                sx += len - mlen;
+            //an empty match steps over one character so it is not offered again
+            x += len + (mlen == 0);
+            replaced++;
+        }
+        else if(c == 'n' || c == 'N'){
+            x = groups[0].rm_eo + (groups[0].rm_eo == groups[0].rm_so);
+        }
+        else{
+            editorSetStatusMessage("Replaced %d", replaced);
+            break;
+        }
+        editorSetStatusMessage("Replaced %d", replaced);
+        if(x > e.row[y].size){
+            x = 0;
+            if(++y == e.numrows){
+                y = 0;
+                wrapped = 1;
+            }
+        }
+    }
+    replaceFreePattern(&pat);
+    free(query);
+    free(with);
+}
@@ -0,0 +1,129 @@
+/*** includes ***/
+
+#include "headless.h"
+
+#include<stdlib.h>
+#include<string.h>
+
+/*** replay ***/
+
+//headless test driver: opens a file, replays a key script against a virtual screen and prints the final screen
+
+static char *readWholeFile(const char *path){
+    FILE *fp = fopen(path, "r");
+    if(!fp)
+        return NULL;
+    size_t cap = 4096, len = 0;
+    char *buf = malloc(cap);
+    size_t n;
+    while((n = fread(buf + len, 1, cap - len - 1, fp)) > 0){
+        len += n;
+        if(len == cap - 1){
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    buf[len] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+static void usage(){
+    fprintf(stderr, "usage: replay [-r rows] [-c cols] [-o rawfile] [-k keys | -s scriptfile | -p keys | -x command]... [file]\n");
+    exit(2);
+}
+
+//the key scripts and shell commands given on the command line, run in order
+struct step{
+    //key script, or NULL for a command
+    char *keys;
+    char *command;
+    //set when the keys arrive all at once, like a paste
+    int paste;
+};
+
+int main(int argc, char *argv[]){
+    int rows = 24, cols = 80;
+    struct step steps[64];
+    int nsteps = 0;
+    char *filename = NULL;
+    char *rawfile = NULL;
+    int i;
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            rows = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            cols = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            rawfile = argv[++i];
+        else if((strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "-x") == 0) && i + 1 < argc){
+            if(nsteps == (int)(sizeof(steps) / sizeof(steps[0])))
+                usage();
+            struct step *st = &steps[nsteps++];
+            st->keys = NULL;
+            st->command = NULL;
+            st->paste = argv[i][1] == 'p';
+            if(argv[i][1] == 'k' || argv[i][1] == 'p')
+                st->keys = strdup(argv[++i]);
+            else if(argv[i][1] == 'x')
+                st->command = argv[++i];
+            else if(!(st->keys = readWholeFile(argv[++i]))){
+                perror(argv[i]);
+                return 1;
+            }
+        }
+        else if(argv[i][0] == '-' || filename)
+            usage();
+        else
+            filename = argv[i];
+    }
+    if(rows < 3 || cols < 1)
+        usage();
+
+    headlessInit(rows, cols);
+    headlessTrackScreen(1);
+    //the raw output keeps the escape sequences the virtual screen drops, such as the synchronized output around each frame
+    if(rawfile && !(headless_raw = fopen(rawfile, "w"))){
+        perror(rawfile);
+        return 1;
+    }
+    //a hangup sent by a -x command leaves the swap file behind the way it would for the editor
+    journalInstallSignals();
+    //keys up to the first command or paste are queued before the file is opened, so they also answer prompts shown while opening it
+    for(i = 0; i < nsteps && steps[i].keys && !steps[i].paste; i++){
+        if(headlessQueueScript(steps[i].keys) == -1){
+            fprintf(stderr, "replay: bad key name in script\n");
+            return 2;
+        }
+    }
+    if(filename)
+        editorOpen(filename);
+    headlessRun();
+    //commands run between the keys before and after them, e.g. to change the file on disk while it is open
+    for(; i < nsteps; i++){
+        if(steps[i].command){
+            fflush(stdout);
+            if(system(steps[i].command) != 0)
+                fprintf(stderr, "replay: command failed: %s\n", steps[i].command);
+            continue;
+        }
+        if(headlessQueueScript(steps[i].keys) == -1){
+            fprintf(stderr, "replay: bad key name in script\n");
+            return 2;
+        }
+        if(steps[i].paste)
+            headlessPaste();
+        headlessRun();
+    }
+    for(i = 0; i < nsteps; i++)
+        free(steps[i].keys);
+
+    vscreenDump(headless_screen, stdout);
+    headlessShutdown();
+    if(headless_raw)
+        fclose(headless_raw);
+    //discards the buffer the way quitting does, so no swap file is left behind
+    editorReset();
+    return 0;
+}
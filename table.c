@@ -0,0 +1,475 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<pthread.h>
+#include<stdint.h>
+#include<stdlib.h>
+#include<string.h>
+#include<strings.h>
+#include<unistd.h>
+
+#include "alloc.h"
+
+/*** data ***/
+
+//column widths are kept per chunk of rows, so an edit only sends its own chunk back to be measured
+#define TABLE_CHUNK_ROWS 65536
+#define TABLE_MAX_THREADS 16
+//columns past this many are not laid out, and no column is drawn wider than TABLE_MAX_WIDTH
+#define TABLE_MAX_COLS 1024
+#define TABLE_MAX_WIDTH 40
+//the " | " drawn between two columns
+#define TABLE_GAP 3
+//rows inserted in one go up to this many are measured straight away instead of waiting for the editor to go idle
+#define TABLE_MEASURE_NOW 64
+
+static struct{
+    int active;
+    char delim;
+    //the layout every row is drawn with: width[c] and the screen column colx[c] where column c starts
+    int ncols;
+    int width[TABLE_MAX_COLS];
+    int colx[TABLE_MAX_COLS + 1];
+    //widest field of each column within each chunk, chunkcols[k] columns of TABLE_MAX_COLS are used in chunk k
+    int nchunks;
+    int *chunkwidth;
+    int *chunkcols;
+    unsigned char *dirty;
+    int anydirty;
+    //the line being drawn, one screen wide
+    char *line;
+    int linecap;
+} table;
+
+struct tableJob{
+    const int *chunks;
+    int n;
+};
+
+/*** fields ***/
+
+static int tableFieldEnd(const char *s, int size, int at){
+    //index of the delimiter ending the field that starts at at, or size for the last field
+    //a field starting with a quote runs to the closing quote, and a doubled quote inside it is part of the text
+    int i = at;
+    if(i < size && s[i] == '"'){
+        for(i++; i < size; i++){
+            const char *q = memchr(s + i, '"', size - i);
+            if(!q)
+                return size;
+            i = q - s;
+            if(i + 1 < size && s[i + 1] == '"'){
+                i++;
+                continue;
+            }
+            i++;
+            break;
+        }
+    }
+    const char *d = i < size ? memchr(s + i, table.delim, size - i) : NULL;
+    return d ? d - s : size;
+}
+
+static int tableMeasureRow(const erow *row, int *width){
+    //raises width[c] to the width of field c of row, returns the number of fields
+    int c = 0, at = 0;
+    while(c < TABLE_MAX_COLS){
+        int end = tableFieldEnd(row->chars, row->size, at);
+        int w = end - at > TABLE_MAX_WIDTH ? TABLE_MAX_WIDTH : end - at;
+        if(w > width[c])
+            width[c] = w;
+        c++;
+        if(end >= row->size)
+            break;
+        at = end + 1;
+    }
+    return c;
+}
+
+static void tableParseRow(erow *row){
+    //caches where each field of row starts, fields[numfields] is one past the end of the last field plus its delimiter
+    if(row->fields)
+        return;
+    int cap = 8, at = 0;
+    row->fields = malloc(sizeof(int) * cap);
+    row->numfields = 0;
+    for(;;){
+        if(row->numfields + 1 >= cap){
+            cap *= 2;
+            row->fields = realloc(row->fields, sizeof(int) * cap);
+        }
+        int end = tableFieldEnd(row->chars, row->size, at);
+        row->fields[row->numfields++] = at;
+        at = end + 1;
+        if(end >= row->size || row->numfields == TABLE_MAX_COLS)
+            break;
+    }
+    row->fields[row->numfields] = at;
+}
+
+static int tableFieldAt(erow *row, int cx){
+    //index of the field holding character cx
+    int lo = 0, hi = row->numfields - 1, found = 0;
+    while(lo <= hi){
+        int mid = (lo + hi) / 2;
+        if(row->fields[mid] <= cx){
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    return found;
+}
+
+/*** column widths ***/
+
+static void tableLayout(){
+    //combines the widths of every chunk into the layout
+    int c, k;
+    table.ncols = 0;
+    for(k = 0; k < table.nchunks; k++){
+        if(table.chunkcols[k] > table.ncols)
+            table.ncols = table.chunkcols[k];
+    }
+    for(c = 0; c < table.ncols; c++)
+        table.width[c] = 1;
+    for(k = 0; k < table.nchunks; k++){
+        int *w = &table.chunkwidth[(size_t)k * TABLE_MAX_COLS];
+        for(c = 0; c < table.chunkcols[k]; c++){
+            if(w[c] > table.width[c])
+                table.width[c] = w[c];
+        }
+    }
+    table.colx[0] = 0;
+    for(c = 0; c < table.ncols; c++)
+        table.colx[c + 1] = table.colx[c] + table.width[c] + TABLE_GAP;
+}
+
+static void tableGrow(const int *width, int ncols){
+    //widens the layout at once for a field that just got wider, narrowing waits for its chunk to be measured again
+    int c, changed = 0;
+    for(c = 0; c < ncols; c++){
+        if(c >= table.ncols){
+            table.width[c] = 1;
+            table.ncols = c + 1;
+            changed = 1;
+        }
+        if(width[c] > table.width[c]){
+            table.width[c] = width[c];
+            changed = 1;
+        }
+    }
+    if(!changed)
+        return;
+    for(c = 0; c < table.ncols; c++)
+        table.colx[c + 1] = table.colx[c] + table.width[c] + TABLE_GAP;
+}
+
+static void tableMeasureChunk(int k){
+    int *w = &table.chunkwidth[(size_t)k * TABLE_MAX_COLS];
+    int y, end = (k + 1) * TABLE_CHUNK_ROWS, ncols = 0;
+    if(end > e.numrows)
+        end = e.numrows;
+    memset(w, 0, sizeof(int) * TABLE_MAX_COLS);
+    for(y = k * TABLE_CHUNK_ROWS; y < end; y++){
+        int n = tableMeasureRow(&e.row[y], w);
+        if(n > ncols)
+            ncols = n;
+    }
+    table.chunkcols[k] = ncols;
+}
+
+static void *tableWorker(void *arg){
+    //each chunk writes only its own slot of chunkwidth, so the threads share nothing else
+    struct tableJob *job = arg;
+    int i;
+    for(i = 0; i < job->n; i++)
+        tableMeasureChunk(job->chunks[i]);
+    return NULL;
+}
+
+static void tableResize(){
+    //keeps one chunk per TABLE_CHUNK_ROWS rows, new chunks start out dirty
+    int k, n = (e.numrows + TABLE_CHUNK_ROWS - 1) / TABLE_CHUNK_ROWS;
+    if(n < 1)
+        n = 1;
+    if(n > table.nchunks){
+        table.chunkwidth = realloc(table.chunkwidth, sizeof(int) * TABLE_MAX_COLS * (size_t)n);
+        table.chunkcols = realloc(table.chunkcols, sizeof(int) * n);
+        table.dirty = realloc(table.dirty, n);
+        for(k = table.nchunks; k < n; k++){
+            table.chunkcols[k] = 0;
+            table.dirty[k] = 1;
+        }
+        table.anydirty = 1;
+    }
+    table.nchunks = n;
+}
+
+static void tableMarkRows(int at, int n){
+    //the chunks holding rows [at, at + n) are measured again when the editor is next idle
+    int k;
+    tableResize();
+    if(n < 1)
+        n = 1;
+    for(k = at / TABLE_CHUNK_ROWS; k <= (at + n - 1) / TABLE_CHUNK_ROWS && k < table.nchunks; k++)
+        table.dirty[k] = 1;
+    table.anydirty = 1;
+}
+
+static void tableRefresh(){
+    //measures every dirty chunk, spread over as many threads as there are cores, then lays the columns out again
+    int k, i, ndirty = 0;
+    tableResize();
+    int *chunks = malloc(sizeof(int) * table.nchunks);
+    for(k = 0; k < table.nchunks; k++){
+        if(table.dirty[k])
+            chunks[ndirty++] = k;
+        table.dirty[k] = 0;
+    }
+    table.anydirty = 0;
+
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads > ndirty)
+        nthreads = ndirty;
+    if(nthreads > TABLE_MAX_THREADS)
+        nthreads = TABLE_MAX_THREADS;
+    if(nthreads < 1)
+        nthreads = 1;
+
+    struct tableJob jobs[TABLE_MAX_THREADS];
+    pthread_t threads[TABLE_MAX_THREADS];
+    int started[TABLE_MAX_THREADS];
+    for(i = 0; i < nthreads; i++){
+        int from = ndirty * i / nthreads, to = ndirty * (i + 1) / nthreads;
+        jobs[i] = (struct tableJob){chunks + from, to - from};
+        //the main thread takes the first share itself, and any share a thread could not be started for
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, tableWorker, &jobs[i]) == 0;
+    }
+    for(i = 0; i < nthreads; i++){
+        if(!started[i])
+            tableWorker(&jobs[i]);
+    }
+    for(i = 1; i < nthreads; i++){
+        if(started[i])
+            pthread_join(threads[i], NULL);
+    }
+    free(chunks);
+    tableLayout();
+}
+
+/*** hooks ***/
+
+int tableActive(){
+    return table.active;
+}
+
+void tableRowChanged(erow *row){
+    //a row of the buffer was edited in place, rows still being built elsewhere are measured once they are inserted
+    uintptr_t off = (uintptr_t)row - (uintptr_t)e.row;
+    if(!table.active || !e.row || off >= sizeof(erow) * (size_t)e.numrows)
+        return;
+    int width[TABLE_MAX_COLS] = {0};
+    tableGrow(width, tableMeasureRow(row, width));
+    tableMarkRows(off / sizeof(erow), 1);
+}
+
+static void tableMeasureInto(int k, int from, int to){
+    //adds rows [from, to) to the widths of chunk k without measuring the rest of it again
+    int *w = &table.chunkwidth[(size_t)k * TABLE_MAX_COLS];
+    int y;
+    for(y = from; y < to && y < e.numrows; y++){
+        int c = tableMeasureRow(&e.row[y], w);
+        if(c > table.chunkcols[k])
+            table.chunkcols[k] = c;
+    }
+}
+
+void tableRowsInserted(int at, int n){
+    int y, k;
+    if(!table.active)
+        return;
+    if(n > TABLE_MEASURE_NOW){
+        //every row below moved, so every chunk from here down is measured again
+        tableMarkRows(at, e.numrows - at);
+        return;
+    }
+    tableMarkRows(at, n);
+    //the last n rows of each chunk below were pushed into the next one, which counts them from now on
+    //so measuring the chunk they left again doesn't drop their widths
+    for(k = at / TABLE_CHUNK_ROWS + 1; k < table.nchunks; k++)
+        tableMeasureInto(k, k * TABLE_CHUNK_ROWS, k * TABLE_CHUNK_ROWS + n);
+    int width[TABLE_MAX_COLS] = {0}, ncols = 0;
+    for(y = at; y < at + n && y < e.numrows; y++){
+        int c = tableMeasureRow(&e.row[y], width);
+        if(c > ncols)
+            ncols = c;
+    }
+    tableGrow(width, ncols);
+}
+
+void tableRowsDeleted(int at, int n){
+    //the rows are gone, so only the chunk they were cut out of can have got narrower
+    (void)n;
+    if(table.active && e.numrows > 0)
+        tableMarkRows(at < e.numrows ? at : e.numrows - 1, 1);
+}
+
+void tableIdle(){
+    //chunks touched by edits are measured again while nothing else is going on
+    if(table.active && table.anydirty)
+        tableRefresh();
+}
+
+/*** drawing ***/
+
+int tableCxtoRx(erow *row, int cx){
+    //screen column of character cx in the table layout
+    tableParseRow(row);
+    int c = tableFieldAt(row, cx);
+    if(c >= table.ncols)
+        return table.colx[table.ncols];
+    int off = cx - row->fields[c];
+    if(off > table.width[c])
+        off = table.width[c];
+    return table.colx[c] + off;
+}
+
+int tableDrawRow(struct abuf *ab, erow *row, int header){
+    //draws the part of row between e.coloff and the right edge of the screen, each field padded to its column
+    //returns how many screen columns were drawn
+    int left = e.coloff, right = e.coloff + e.screencols;
+    int lo = 0, hi = table.ncols - 1, c = table.ncols;
+    //the first column reaching past the left edge, found without looking at the columns scrolled off to the left
+    while(lo <= hi){
+        int mid = (lo + hi) / 2;
+        if(table.colx[mid + 1] > left){
+            c = mid;
+            hi = mid - 1;
+        }
+        else
+            lo = mid + 1;
+    }
+    if(table.linecap < e.screencols){
+        table.linecap = e.screencols;
+        table.line = realloc(table.line, table.linecap);
+    }
+    tableParseRow(row);
+    int len = 0;
+    for(; c < table.ncols && table.colx[c] < right; c++){
+        const char *text = "";
+        int textlen = 0;
+        if(c < row->numfields){
+            text = row->chars + row->fields[c];
+            textlen = row->fields[c + 1] - 1 - row->fields[c];
+        }
+        int p = table.colx[c] < left ? left : table.colx[c];
+        int stop = table.colx[c + 1] < right ? table.colx[c + 1] : right;
+        for(; p < stop; p++){
+            int off = p - table.colx[c];
+            char ch = ' ';
+            if(off < table.width[c]){
+                if(off < textlen)
+                    ch = text[off];
+                //tabs and other control characters would throw the columns out of line
+                if((unsigned char)ch < 32 || ch == 127)
+                    ch = ' ';
+            }
+            else if(off == table.width[c] + 1 && c + 1 < table.ncols){
+                ch = '|';
+            }
+            table.line[len++] = ch;
+        }
+    }
+    if(header)
+        abAppend(ab, "\x1b[1m", 4);
+    abAppend(ab, table.line, len);
+    if(header)
+        abAppend(ab, "\x1b[m", 3);
+    return len;
+}
+
+/*** commands ***/
+
+static void tableForgetRows(){
+    //the cached field positions belong to the delimiter they were split with
+    int y;
+    for(y = 0; y < e.numrows; y++){
+        free(e.row[y].fields);
+        e.row[y].fields = NULL;
+        e.row[y].numfields = 0;
+    }
+}
+
+void tableClear(){
+    tableForgetRows();
+    free(table.chunkwidth);
+    free(table.chunkcols);
+    free(table.dirty);
+    free(table.line);
+    memset(&table, 0, sizeof(table));
+}
+
+static char tableDelimiter(const char *filename){
+    //the delimiter comes from the extension, otherwise it is whichever of tab, comma, semicolon or bar the first row has most of
+    const char *ext = filename ? strrchr(filename, '.') : NULL;
+    if(ext && !strcasecmp(ext, ".csv"))
+        return ',';
+    if(ext && (!strcasecmp(ext, ".tsv") || !strcasecmp(ext, ".tab")))
+        return '\t';
+    if(e.numrows == 0)
+        return 0;
+    const char *candidates = "\t,;|";
+    int i, j, best = 0;
+    char delim = 0;
+    for(i = 0; candidates[i]; i++){
+        int n = 0;
+        for(j = 0; j < e.row[0].size; j++){
+            if(e.row[0].chars[j] == candidates[i])
+                n++;
+        }
+        if(n > best){
+            best = n;
+            delim = candidates[i];
+        }
+    }
+    return delim;
+}
+
+static void tableEnable(char delim){
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    tableClear();
+    table.active = 1;
+    table.delim = delim;
+    tableRefresh();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    char name[3] = {delim, '\0', '\0'};
+    if(delim == '\t')
+        memcpy(name, "\\t", 3);
+    editorSetStatusMessage("Table view: %d columns split on '%s', measured in %.0f ms", table.ncols, name, ms);
+}
+
+void tableOpenFile(const char *filename){
+    //csv and tsv files open in the table view
+    const char *ext = strrchr(filename, '.');
+    if(ext && (!strcasecmp(ext, ".csv") || !strcasecmp(ext, ".tsv") || !strcasecmp(ext, ".tab")))
+        tableEnable(tableDelimiter(filename));
+}
+
+void editorToggleTable(){
+    if(table.active){
+        tableClear();
+        editorSetStatusMessage("Table view off");
+        return;
+    }
+    char delim = tableDelimiter(e.filename);
+    if(!delim){
+        editorSetStatusMessage("No delimiter found on the first row");
+        return;
+    }
+    tableEnable(delim);
+}
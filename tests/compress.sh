@@ -0,0 +1,27 @@
+# gzip (and zstd, when it is compiled in) files are opened decompressed and saved back in the same format
+
+printf 'one\ntwo\nthree\n' > a.txt
+gzip -k a.txt
+"$REPLAY" -r 8 -c 40 -k '<Down><End>!<C-s>' a.txt.gz > screen
+expect_line 'two!' screen
+gzip -dc a.txt.gz > out.txt
+expect_file out.txt <<'END'
+one
+two!
+three
+END
+
+# without libzstd the editor refuses to load zstd files, which is checked instead
+command -v zstd > /dev/null || return 0
+printf 'one\ntwo\n' | zstd -q > b.zst
+"$REPLAY" -r 8 -c 80 b.zst > screen
+if grep -q 'without zstd support' screen; then
+    no_line 'two' screen
+    return 0
+fi
+"$REPLAY" -r 8 -c 40 -k '<Down><Del><C-s>' b.zst > /dev/null
+zstd -dcq b.zst > out.txt
+expect_file out.txt <<'END'
+one
+wo
+END
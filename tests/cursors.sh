@@ -0,0 +1,39 @@
+# typing at several cursors, replacing a column selection and splitting rows at every cursor, then the same edits replayed from the swap file
+
+printf 'int a;\nint b;\nint c;\nint d;\n' > a.txt
+cp a.txt b.txt
+keys='<C-n><C-n>const <Esc><Up><Up><End><Left><Left><S-Down><S-Down><S-Right>var<Esc><Up><Up><Home><C-n><Right><Right><Right><Right><Right><CR><Right><BS>'
+
+"$REPLAY" -r 10 -c 40 -k "$keys<C-s>" a.txt > screen
+expect_file a.txt <<'END'
+const
+int var;
+const
+int var;
+const int var;
+int d;
+END
+expect_line 'a.txt - 6 lines' screen
+
+# batched edits reach the journal as plain row operations, which replay to the same buffer
+"$REPLAY" -r 10 -c 40 -k "$keys" -x 'kill -HUP $PPID' -k 'x' b.txt > /dev/null
+"$REPLAY" -r 10 -c 40 -k 'y<C-s>' b.txt > /dev/null
+cmp -s a.txt b.txt || { diff a.txt b.txt; fail "edits recovered from the swap file differ"; }
+
+# the selection's column can't run past the row it's on, and shorter rows below keep the cursor within them
+printf 'ab\nabcdef\nx\n' > c.txt
+"$REPLAY" -r 8 -c 40 -k '<S-Right><S-Right><S-Right><S-Right><S-Right><S-Right><S-Down><S-Down>Z<C-s>' c.txt > /dev/null
+expect_file c.txt <<'END'
+Z
+Zcdef
+Z
+END
+
+# rows that end left of a selection are not touched by deleting it or by typing afterwards
+printf 'abcdefgh\nab\nabcdefgh\n' > d.txt
+"$REPLAY" -r 8 -c 40 -k '<Right><Right><Right><Right><S-Right><S-Right><S-Down><S-Down><BS>Z<C-s>' d.txt > /dev/null
+expect_file d.txt <<'END'
+abcdZgh
+ab
+abcdZgh
+END
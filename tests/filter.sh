@@ -0,0 +1,36 @@
+# rows of the selection, or the whole file, are streamed through a command and replaced by its output
+
+printf 'c\na\nd\nb\n' > a.txt
+"$REPLAY" -r 8 -c 70 -k '<C-e>sort<CR><C-s>' a.txt > /dev/null
+expect_file a.txt <<'END'
+a
+b
+c
+d
+END
+
+# output longer than the selection pushes the rows below it down
+"$REPLAY" -r 8 -c 70 -k '<Down><S-Down><C-e>sed p<CR><C-s>' a.txt > /dev/null
+expect_file a.txt <<'END'
+a
+b
+b
+c
+c
+d
+END
+
+# a command that fails leaves the buffer alone
+"$REPLAY" -r 8 -c 70 -k '<C-e>false<CR>' a.txt > screen
+expect_line 'false exited with 1' screen
+no_line 'modified' screen
+
+# a file larger than the pipe buffers on both sides comes back whole, and the splice journals like any other edit
+seq 1 30000 > big.txt
+cp big.txt swp.txt
+awk '{ print $0 "!" }' big.txt | sed 1d > want.txt
+"$REPLAY" -r 8 -c 70 -k "<C-e>awk '{ print \$0 \"!\" }' | sed 1d<CR><C-s>" big.txt > /dev/null
+cmp -s big.txt want.txt || fail "filtered file differs from running the command on it"
+"$REPLAY" -r 8 -c 70 -k "<C-e>awk '{ print \$0 \"!\" }' | sed 1d<CR>" -x 'kill -HUP $PPID' -k 'x' swp.txt > /dev/null
+"$REPLAY" -r 8 -c 70 -k 'y<C-s>' swp.txt > /dev/null
+cmp -s swp.txt want.txt || fail "filter recovered from the swap file differs"
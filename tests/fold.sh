@@ -0,0 +1,47 @@
+# folding blocks by brackets and by indentation, folds following edits, and toggling every fold in a single pass over the file
+
+printf 'int f(){\n    a;\n    b;\n}\ndef g():\n    x\n    y\nend\nh(1,\n  2);\n' > a.txt
+"$REPLAY" -r 12 -c 40 -k '<C-k>' a.txt > screen
+expect_line 'int f(){ ... 3 lines' screen
+expect_line 'def g():' screen
+no_line '    a;' screen
+
+"$REPLAY" -r 12 -c 40 -k '<C-o>' a.txt > screen
+expect_file screen <<'END'
+int f(){ ... 3 lines
+def g(): ... 2 lines
+end
+h(1, ... 1 lines
+~
+~
+~
+~
+~
+~
+a.txt - 10 lines                    1/10
+3 blocks folded
+END
+
+# rows inserted above a fold move it down, and a search that lands inside a fold opens it
+"$REPLAY" -r 12 -c 40 -k '<C-o><CR><Up>top<Down><Down><Down><Home>X' a.txt > screen
+expect_line 'int f(){ ... 3 lines' screen
+expect_line 'def g(): ... 2 lines' screen
+expect_line 'Xend' screen
+"$REPLAY" -r 12 -c 40 -k '<C-k><C-f>b;<CR>' a.txt > screen
+expect_line '    b;' screen
+no_line '... 3 lines' screen
+
+# a bracket that is never closed falls back to the rows indented deeper below it
+printf 'x = call(\n    a,\n    b\nnext\n' > b.txt
+"$REPLAY" -r 8 -c 40 -k '<C-k>' b.txt > screen
+expect_line 'x = call( ... 2 lines' screen
+expect_line 'next' screen
+
+# every row opening a bracket that is never closed used to send its scan to the end of the file, toggling all folds took 49 s here
+i=0
+while [ $i -lt 32000 ]; do
+    echo "call($i, {"
+    i=$((i + 1))
+done > c.txt
+timeout 10 "$REPLAY" -r 8 -c 40 -k '<C-o>' c.txt > screen || fail "toggling all folds did not finish in 10 s"
+expect_line '0 blocks folded' screen
@@ -0,0 +1,31 @@
+# every frame is wrapped in synchronized output, and keys that arrive together are drawn as one frame instead of one each
+
+printf 'one\ntwo\n' > a.txt
+
+# frames lists the h (begin) and l (end) of each synchronized output sequence in a raw capture, in order
+frames(){
+    tr '\033\r\n' 'E  ' < "$1" | grep -o 'E\[?2026[hl]' | sed 's/.*\(.\)$/\1/' | tr -d '\n'
+}
+
+# wrapped raw: the capture starts and ends with the sequences and nothing is written between the end of a frame and the start of the next
+wrapped(){
+    tr '\033\r\n' 'E  ' < "$1" > flat
+    [ "$(head -c 8 flat)" = 'E[?2026h' ] || fail "$1 does not start with the begin of a frame"
+    [ "$(tail -c 8 flat)" = 'E[?2026l' ] || fail "$1 does not end with the end of a frame"
+    [ "$(sed 's/E\[?2026lE\[?2026h//g' flat | grep -o 'E\[?2026[hl]' | wc -l)" = 2 ] || fail "$1 has output between frames"
+    echo "$(frames "$1")" | grep -qx '\(hl\)*' || fail "begin and end of frame don't alternate in $1: $(frames "$1")"
+}
+
+# typed keys get a frame each, besides the ones drawn before the first key
+"$REPLAY" -r 6 -c 30 -o typed.raw -k 'hello world' a.txt > typed
+wrapped typed.raw
+typed=$(frames typed.raw | grep -o h | wc -l)
+[ "$typed" -ge 11 ] || fail "only $typed frames for 11 typed keys"
+
+# the same keys pasted leave the same screen with far fewer frames
+"$REPLAY" -r 6 -c 30 -o pasted.raw -p 'hello world' a.txt > pasted
+wrapped pasted.raw
+pasted=$(frames pasted.raw | grep -o h | wc -l)
+[ "$pasted" -lt 11 ] || fail "$pasted frames for 11 pasted keys, they were not coalesced"
+cmp -s typed pasted || { diff typed pasted; fail "pasting left a different screen than typing"; }
+expect_line 'hello worldone' pasted
@@ -0,0 +1,20 @@
+# typing, enter, backspace and save through the headless driver, checked on the final screen and on disk
+
+printf 'first line\nsecond line\n' > a.txt
+"$REPLAY" -r 8 -c 40 -k '<Down><End> more<CR>new row<BS><BS><BS>line<Up><Home>X<C-s>' a.txt > screen
+
+expect_file a.txt <<'END'
+first line
+Xsecond line more
+new line
+END
+expect_file screen <<'END'
+first line
+Xsecond line more
+new line
+~
+~
+~
+a.txt - 3 lines                      2/3
+38 bytes written to disk
+END
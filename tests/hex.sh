@@ -0,0 +1,33 @@
+# the hex view: patching and saving bytes, searching for byte patterns, and saving over a file another program changed
+
+printf '\000\001\002\003hello\336\255\276\357world\000tail' > a.bin
+cp a.bin orig.bin
+
+# opening and saving without a patch writes nothing and leaves every byte as it was
+"$REPLAY" -r 6 -c 80 -k '<C-s>' a.bin > screen
+expect_line '00000000  00 01 02 03 68 65 6c 6c  6f de ad be ef 77 6f 72  |....hello....wor|' screen
+expect_line 'a.bin - 23 bytes (hex)' screen
+expect_line '0 bytes written to disk' screen
+cmp -s a.bin orig.bin || fail "saving without a patch changed the file"
+
+# hex digits overwrite the byte under the cursor a nibble at a time
+"$REPLAY" -r 6 -c 80 -k 'ff<Right>7<C-s>' a.bin > screen
+expect_line '00000000  ff 01 72 03 68 65' screen
+expect_line '23 bytes written to disk' screen
+[ "$(od -An -tx1 -N 4 a.bin)" = " ff 01 72 03" ] || fail "patched bytes were not written to the file"
+
+# a pattern of hex bytes or quoted text moves the cursor to its first byte
+"$REPLAY" -r 6 -c 80 -k '<C-f>de ad<CR>' a.bin > screen
+expect_line '0x9/0x17' screen
+"$REPLAY" -r 6 -c 80 -k '<C-f>"world"<CR>' a.bin > screen
+expect_line '0xd/0x17' screen
+
+# a change made on disk after the file was opened is only overwritten when the user says so
+cp orig.bin a.bin
+"$REPLAY" -r 6 -c 80 -k 'ff' -x 'printf X | dd of=a.bin bs=1 seek=5 conv=notrunc 2>/dev/null' -k '<C-s>n' a.bin > screen
+expect_line 'Save aborted' screen
+[ "$(od -An -c -j 4 -N 2 a.bin)" = "   h   X" ] || fail "the change on disk was overwritten"
+[ "$(od -An -tx1 -N 1 a.bin)" = " 00" ] || fail "the patch was written after the save was declined"
+"$REPLAY" -r 6 -c 80 -k 'ff' -x 'printf X | dd of=a.bin bs=1 seek=5 conv=notrunc 2>/dev/null' -k '<C-s>y' a.bin > screen
+expect_line '23 bytes written to disk' screen
+[ "$(od -An -tx1 -N 1 a.bin)" = " ff" ] || fail "the patch was not written after confirming"
@@ -0,0 +1,45 @@
+# edits are journaled to the swap file, survive a hangup and are replayed on the next open, also after the swap file was compacted
+
+# a hangup syncs the swap file and exits without touching the file itself
+printf 'alpha\nbeta\ngamma\n' > a.txt
+"$REPLAY" -r 8 -c 40 -k '<Down><End> two<CR>new<Up><Up><Del>' -x 'kill -HUP $PPID' -k 'x' a.txt > /dev/null && fail "replay kept running after the hangup"
+[ -s .a.txt.swp ] || fail "no swap file after the hangup"
+expect_file a.txt <<'END'
+alpha
+beta
+gamma
+END
+
+# declining the recovery leaves the buffer as it is on disk
+"$REPLAY" -r 8 -c 40 -k 'n' a.txt > screen
+expect_line 'alpha' screen
+no_line 'beta two' screen
+
+# accepting it replays the edits, and saving removes the swap file
+"$REPLAY" -r 8 -c 40 -k 'x' -x 'kill -HUP $PPID' -k 'x' a.txt > /dev/null
+"$REPLAY" -r 8 -c 40 -k 'y<C-s>' a.txt > screen
+expect_file a.txt <<'END'
+xalpha
+beta
+gamma
+END
+[ ! -e .a.txt.swp ] || fail "swap file left behind after saving"
+
+# a swap file written against another version of the file is set aside instead of being replayed
+"$REPLAY" -r 8 -c 40 -k 'junk' -x 'kill -HUP $PPID' -k 'x' a.txt > /dev/null
+printf 'changed\n' > a.txt
+"$REPLAY" -r 8 -c 40 a.txt > screen
+expect_line 'changed' screen
+no_line 'junk' screen
+[ -s .a.txt.swp.old ] || fail "stale swap file was not moved aside"
+
+# past 1 MB the swap file is compacted in the background, replaying the compacted file gives the same buffer
+keys='<C-e>seq 1 150000<CR><Down>'
+more='<Down><End>ab<Up><BS><BS><Down><Down><Down><CR>cd'
+printf 'x\n' > big.txt
+printf 'x\n' > ref.txt
+"$REPLAY" -r 8 -c 40 -k "$keys" -x 'stat -c %i .big.txt.swp > inode; sleep 1' -k "$more" -x 'stat -c %i .big.txt.swp >> inode; kill -HUP $PPID' -k 'x' big.txt > /dev/null
+[ "$(sort -u inode | wc -l)" = 2 ] || fail "the swap file was not compacted"
+"$REPLAY" -r 8 -c 40 -k 'y<C-s>' big.txt > /dev/null
+"$REPLAY" -r 8 -c 40 -k "$keys$more<C-s>" ref.txt > /dev/null
+cmp -s big.txt ref.txt || fail "buffer recovered from the compacted swap file differs"
@@ -0,0 +1,23 @@
+# helpers sourced by every test, which runs in a scratch directory with $REPLAY set to the replay binary
+
+fail(){
+    echo "$*"
+    exit 1
+}
+
+# expect_file path: the file must hold exactly the text given on stdin
+expect_file(){
+    cat > .expected
+    [ -f "$1" ] || fail "$1 does not exist"
+    cmp -s .expected "$1" || { diff -u .expected "$1"; fail "$1 differs from what was expected"; }
+}
+
+# expect_line text file: some line of a screen dump (or any file) must contain text
+expect_line(){
+    grep -qF -- "$1" "$2" || { cat "$2"; fail "no line contains: $1"; }
+}
+
+# no_line text file: no line may contain text
+no_line(){
+    ! grep -qF -- "$1" "$2" || { cat "$2"; fail "a line contains: $1"; }
+}
@@ -0,0 +1,48 @@
+# changes made to the open file on disk are merged into the buffer, unsaved edits are kept and clashes are left to the user
+
+# a clean buffer follows the file once the idle loop notices the change
+printf 'l1\nl2\nl3\n' > a.txt
+"$REPLAY" -r 8 -c 70 -k '<Down>' -x "printf 'l1\nnew\nl2\nl3\n' > a.txt; sleep 1" -k '<Down>' a.txt > screen
+expect_line 'new' screen
+expect_line 'a.txt - 4 lines ' screen
+
+# edits on both sides that don't touch the same rows are merged, and saving writes both
+printf 'l1\nl2\nl3\nl4\nl5\n' > a.txt
+"$REPLAY" -r 8 -c 70 -k '<Down>X' -x "sed -i 's/l4/L4/' a.txt; echo l6 >> a.txt" -k '<C-s>' a.txt > /dev/null
+expect_file a.txt <<'END'
+l1
+Xl2
+l3
+L4
+l5
+l6
+END
+
+# on a clash the buffer keeps its own version, and saving asks before overwriting the file
+printf 'l1\nl2\nl3\n' > a.txt
+"$REPLAY" -r 8 -c 70 -k '<Down>X' -x "sed -i 's/l2/L2/' a.txt" -k '<C-s>n' a.txt > screen
+expect_line 'Save aborted' screen
+expect_line 'Xl2' screen
+expect_file a.txt <<'END'
+l1
+L2
+l3
+END
+"$REPLAY" -r 8 -c 70 -k '<Down>X' -x "sed -i 's/L2/M2/' a.txt" -k '<C-s>y' a.txt > /dev/null
+expect_file a.txt <<'END'
+l1
+XL2
+l3
+END
+
+# a large file changed in a few places is diffed rather than reloaded, the result is the same as making both sets of edits
+seq 1 100000 > big.txt
+"$REPLAY" -r 8 -c 70 -k '<Down><Down>X' -x "sed -i -e '50000a inserted' -e '70000d' -e 's/^99999$/changed/' big.txt" -k '<C-s>' big.txt > /dev/null
+seq 1 100000 | sed -e '3s/^/X/' -e '50000a inserted' -e '70000d' -e 's/^99999$/changed/' > want.txt
+cmp -s big.txt want.txt || fail "merged file differs from making both sets of edits"
+
+# a deleted file is reported rather than merged
+printf 'l1\n' > a.txt
+"$REPLAY" -r 8 -c 70 -k 'x' -x 'rm a.txt' -k '<C-s>n' a.txt > screen
+expect_line 'Save aborted' screen
+[ ! -e a.txt ] || fail "the deleted file was written back"
@@ -0,0 +1,32 @@
+# replacing match by match, replace-all with plain and regex queries on a file big enough to be split between threads, and undoing it
+
+printf 'foo bar foo\nbaz foo\nfoo\n' > a.txt
+"$REPLAY" -r 8 -c 50 -k '<C-r>foo<CR>qux<CR>yny<Esc><C-s>' a.txt > /dev/null
+expect_file a.txt <<'END'
+qux bar foo
+baz qux
+foo
+END
+"$REPLAY" -r 8 -c 50 -k '<C-r>/(ba)([rz])/<CR>\2\1<CR>a<C-s>' a.txt > /dev/null
+expect_file a.txt <<'END'
+qux rba foo
+zba qux
+foo
+END
+
+# every row is cut between the threads the same way a single pass would cut it
+seq 1 200000 | sed 's/$/ item 1/' > big.txt
+cp big.txt orig.txt
+sed 's/1/one/g' orig.txt > want.txt
+"$REPLAY" -r 8 -c 50 -k '<C-r>1<CR>one<CR>a<C-s>' big.txt > /dev/null
+cmp -s big.txt want.txt || fail "plain replace-all differs from sed"
+
+cp orig.txt big.txt
+sed -E 's/([0-9]+) item/item \1/g' orig.txt > want.txt
+"$REPLAY" -r 8 -c 50 -k '<C-r>/([0-9]+) item/<CR>item \1<CR>a<C-s>' big.txt > /dev/null
+cmp -s big.txt want.txt || fail "regex replace-all differs from sed -E"
+
+# one ctrl-z takes the whole replace-all back
+cp orig.txt big.txt
+"$REPLAY" -r 8 -c 50 -k '<C-r>item<CR>x<CR>a<C-z><C-s>' big.txt > /dev/null
+cmp -s big.txt orig.txt || fail "undo did not restore the file"
@@ -0,0 +1,24 @@
+#!/bin/sh
+# runs every test script in this directory against a replay binary, each in an empty scratch directory of its own
+# usage: sh tests/run.sh ./replay
+
+[ -x "$1" ] || { echo "usage: sh tests/run.sh path/to/replay" >&2; exit 2; }
+REPLAY=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+TESTS=$(cd "$(dirname "$0")" && pwd)
+export REPLAY TESTS
+
+failed=0
+for t in "$TESTS"/*.sh; do
+    name=$(basename "$t" .sh)
+    case $name in run|lib) continue ;; esac
+    dir=$(mktemp -d)
+    if (cd "$dir" && . "$TESTS/lib.sh" && . "$t") > "$dir.log" 2>&1; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        sed 's/^/     /' "$dir.log"
+        failed=1
+    fi
+    rm -rf "$dir" "$dir.log"
+done
+exit $failed
@@ -0,0 +1,27 @@
+# the table view: columns padded to their widest field, the header pinned while scrolling, and widths following edits
+
+printf 'name,qty,note\napple,3,red\nbanana,12,yellow\nfig,7,dark red\n' > a.csv
+"$REPLAY" -r 8 -c 50 a.csv > screen
+expect_line 'name   | qty | note' screen
+expect_line 'banana | 12  | yellow' screen
+expect_line 'Table view: 3 columns split on' screen
+
+# shortening the widest field narrows its column once the chunk is measured again, a longer row adds a column straight away
+"$REPLAY" -r 8 -c 50 -k '<Down><Down><Right><Del><Del><Del><Del><Del><Down><End>,more' a.csv > screen
+expect_line 'name  | qty | note     |' screen
+expect_line 'b     | 12  | yellow   |' screen
+expect_line 'fig   | 7   | dark red | more' screen
+
+# the first row stays at the top of the screen as the rest scrolls under it
+awk 'BEGIN{print "id,word"; for(i = 1; i <= 30; i++) print i ",w" i}' > b.csv
+"$REPLAY" -r 8 -c 50 -k '<PageDown><PageDown><PageDown>' b.csv > screen
+[ "$(head -n 1 screen)" = 'id | word' ] || { cat screen; fail "the header is not pinned"; }
+expect_line '26 | w26' screen
+no_line '1 | w1' screen
+
+# the wide row closes the first chunk of 65536 rows, a row inserted above pushes it into the second chunk
+# measuring the first chunk again must not lose its width
+awk 'BEGIN{print "key,val"; for(i = 1; i < 65600; i++) print (i == 65535 ? "wide_field_value_here" : "x") "," i}' > c.csv
+"$REPLAY" -r 8 -c 50 -k '<Down><CR><C-f>wide_field<CR>' c.csv > screen
+expect_line 'wide_field_value_here | 65535' screen
+expect_line 'x                     | 65536' screen
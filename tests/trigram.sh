@@ -0,0 +1,31 @@
+# searches through the trigram index land where a search over every row does, after edits too, and the .tri sidecar follows the file
+
+# files under 1 MB are not indexed
+awk 'BEGIN{for(i = 1; i <= 60000; i++) printf "row %06d %s\n", i, (i == 45000 ? "needle" : "filler")}' > a.txt
+
+# split at several cursors, rows typed in the middle of the file, and rows joined by backspace
+for keys in \
+    '<Right><C-n><C-n><CR><Esc><C-f>needle<CR>' \
+    '<C-f>row 030000<CR><End><CR>haystack<C-f>row 000001<CR><C-f>haystack<CR>' \
+    '<C-f>row 020000<CR><Home><BS><BS><BS><Down><Home><BS><C-f>needle<CR>'
+do
+    "$REPLAY" -r 6 -c 40 -k "$keys" a.txt > indexed
+    EDITOR_INDEX=0 "$REPLAY" -r 6 -c 40 -k "$keys" a.txt > linear
+    cmp -s indexed linear || { diff linear indexed; fail "indexed search differs from a linear one after: $keys"; }
+done
+expect_line 'row 045000 needle' indexed
+[ -s .a.txt.tri ] || fail "no index stored next to the file"
+
+# an unchanged file reuses the stored index instead of writing it again
+before=$(stat -c %i .a.txt.tri)
+"$REPLAY" -r 6 -c 40 -k '<C-f>needle<CR>' a.txt > /dev/null
+[ "$(stat -c %i .a.txt.tri)" = "$before" ] || fail "the stored index was rebuilt for an unchanged file"
+
+# the same size and mtime with different content still throws the stored index away, a stale one would step over the changed row
+touch -r a.txt stamp
+sed 's/^row 050000 filler$/row 050000 filmer/' a.txt > b.txt
+cat b.txt > a.txt
+touch -r stamp a.txt
+"$REPLAY" -r 6 -c 40 -k '<C-f>filmer<CR>' a.txt > screen
+expect_line 'row 050000 filmer' screen
+[ "$(stat -c %i .a.txt.tri)" != "$before" ] || fail "the stored index was kept after the file changed"
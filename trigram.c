@@ -0,0 +1,407 @@
+/*** includes ***/
+
+#include "editor.h"
+
+#include<fcntl.h>
+#include<libgen.h>
+#include<poll.h>
+#include<pthread.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include "alloc.h"
+
+/*** data ***/
+
+//rows are filed in blocks, and each block keeps a bloom filter of the trigrams in its rows
+//a search only looks at the rows of blocks whose filter has every trigram of the query
+#define TRIGRAM_BLOCK_ROWS 128
+#define TRIGRAM_BLOCK_BITS 8192
+#define TRIGRAM_BLOCK_WORDS (TRIGRAM_BLOCK_BITS / 64)
+//blocks built between two looks at whether a key is waiting
+#define TRIGRAM_SLICE_BLOCKS 64
+#define TRIGRAM_MAX_THREADS 16
+//files smaller than this are scanned quickly enough without an index
+#define TRIGRAM_MIN_SIZE (1 << 20)
+//trigrams of a query past this many hardly rule out any more blocks
+#define TRIGRAM_MAX_PROBES 64
+
+#define TRIGRAM_MAGIC "EDTRI01\n"
+
+//the sidecar file: this header, the first row of each block, then the filters
+struct trigramHeader{
+    char magic[8];
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t hash;
+    uint32_t blockbits;
+    uint32_t nblocks;
+    uint32_t numrows;
+    uint32_t pad;
+};
+
+static struct{
+    //set while every row carries its block and edits keep the filters up to date
+    int active;
+    char *path;
+    int nblocks;
+    //blocks [0, built) have their filters, the rest are searched row by row until they do
+    int built;
+    uint64_t *bits;
+    //the query the probes below were worked out for
+    char *query;
+    int numprobes;
+    uint32_t probes[TRIGRAM_MAX_PROBES * 2];
+} tri;
+
+struct trigramJob{
+    int from, to;
+};
+
+/*** filters ***/
+
+static void trigramBits(unsigned char a, unsigned char b, unsigned char c, uint32_t *bit1, uint32_t *bit2){
+    //the two filter bits of a trigram, taken from different parts of one multiplicative hash
+    uint64_t h = (((uint64_t)a << 16) | ((uint64_t)b << 8) | c) * 0x9e3779b97f4a7c15ULL;
+    *bit1 = h >> (64 - 13);
+    *bit2 = (h >> 24) & (TRIGRAM_BLOCK_BITS - 1);
+}
+
+static void trigramAddRow(int block, const erow *row){
+    //searches match against render, so that is what gets indexed
+    uint64_t *w = &tri.bits[(size_t)block * TRIGRAM_BLOCK_WORDS];
+    const unsigned char *s = (const unsigned char *)row->render;
+    int i;
+    for(i = 0; i + 2 < row->rsize; i++){
+        uint32_t b1, b2;
+        trigramBits(s[i], s[i + 1], s[i + 2], &b1, &b2);
+        w[b1 >> 6] |= 1ULL << (b1 & 63);
+        w[b2 >> 6] |= 1ULL << (b2 & 63);
+    }
+}
+
+static int trigramBlockMayMatch(int block){
+    //an unbuilt block may hold anything, and so may a row not filed in any block yet, a built one only when every probe bit is set
+    if(block < 0 || block >= tri.built)
+        return 1;
+    const uint64_t *w = &tri.bits[(size_t)block * TRIGRAM_BLOCK_WORDS];
+    int i;
+    for(i = 0; i < tri.numprobes; i++){
+        if(!(w[tri.probes[i] >> 6] & (1ULL << (tri.probes[i] & 63))))
+            return 0;
+    }
+    return 1;
+}
+
+static int trigramFirstRow(int block){
+    //first row filed under block or a later one, rows are filed in order so this is a binary search
+    int lo = 0, hi = e.numrows;
+    while(lo < hi){
+        int mid = lo + (hi - lo) / 2;
+        if(e.row[mid].block < block)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*** building ***/
+
+static void *trigramWorker(void *arg){
+    //each block's filter is written by one thread only
+    struct trigramJob *job = arg;
+    int y;
+    for(y = trigramFirstRow(job->from); y < e.numrows && e.row[y].block < job->to; y++)
+        trigramAddRow(e.row[y].block, &e.row[y]);
+    return NULL;
+}
+
+static void trigramBuildSlice(){
+    //builds the next TRIGRAM_SLICE_BLOCKS blocks, split between as many threads as there are cores
+    int from = tri.built;
+    int to = from + TRIGRAM_SLICE_BLOCKS < tri.nblocks ? from + TRIGRAM_SLICE_BLOCKS : tri.nblocks;
+    int i, nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(nthreads > TRIGRAM_MAX_THREADS)
+        nthreads = TRIGRAM_MAX_THREADS;
+    if(nthreads < 1)
+        nthreads = 1;
+
+    struct trigramJob jobs[TRIGRAM_MAX_THREADS];
+    pthread_t threads[TRIGRAM_MAX_THREADS];
+    int started[TRIGRAM_MAX_THREADS];
+    for(i = 0; i < nthreads; i++){
+        jobs[i] = (struct trigramJob){from + (to - from) * i / nthreads, from + (to - from) * (i + 1) / nthreads};
+        //the main thread takes the first range itself, and any range a thread could not be started for
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, trigramWorker, &jobs[i]) == 0;
+    }
+    for(i = 0; i < nthreads; i++){
+        if(!started[i])
+            trigramWorker(&jobs[i]);
+    }
+    for(i = 1; i < nthreads; i++){
+        if(started[i])
+            pthread_join(threads[i], NULL);
+    }
+    tri.built = to;
+}
+
+/*** sidecar file ***/
+
+char *trigramPath(const char *filename){
+    //the index lives next to the file as .<name>.tri, beside its swap file
+    char *dcopy = strdup(filename);
+    char *bcopy = strdup(filename);
+    char *dir = dirname(dcopy);
+    char *base = basename(bcopy);
+    size_t len = strlen(dir) + strlen(base) + 7;
+    char *path = malloc(len);
+    snprintf(path, len, "%s/.%s.tri", dir, base);
+    free(dcopy);
+    free(bcopy);
+    return path;
+}
+
+static int trigramWriteAll(int fd, const void *buf, size_t len){
+    const char *p = buf;
+    while(len > 0){
+        ssize_t n = write(fd, p, len);
+        if(n == -1)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int trigramReadAll(int fd, void *buf, size_t len){
+    char *p = buf;
+    while(len > 0){
+        ssize_t n = read(fd, p, len);
+        if(n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void trigramStamp(struct trigramHeader *h){
+    //the header for the file as it was last loaded or saved, magic is left empty when that is not known
+    off_t size;
+    struct timespec mtime;
+    uint64_t hash;
+    memset(h, 0, sizeof(*h));
+    if(!reloadStamp(&size, &mtime, &hash))
+        return;
+    memcpy(h->magic, TRIGRAM_MAGIC, sizeof(h->magic));
+    h->size = size;
+    h->mtime_sec = mtime.tv_sec;
+    h->mtime_nsec = mtime.tv_nsec;
+    h->hash = hash;
+    h->blockbits = TRIGRAM_BLOCK_BITS;
+    h->nblocks = tri.nblocks;
+    h->numrows = e.numrows;
+}
+
+static void trigramWrite(){
+    //the index is only stored while the buffer is what is on disk, written aside and renamed so a reader never sees half of it
+    struct trigramHeader h;
+    if(!tri.path || e.dirty || tri.built < tri.nblocks)
+        return;
+    trigramStamp(&h);
+    if(h.magic[0] == '\0')
+        return;
+    uint32_t *start = malloc(sizeof(uint32_t) * tri.nblocks);
+    int b, y = 0;
+    for(b = 0; b < tri.nblocks; b++){
+        while(y < e.numrows && e.row[y].block < b)
+            y++;
+        start[b] = y;
+    }
+    size_t len = strlen(tri.path) + 5;
+    char *tmp = malloc(len);
+    snprintf(tmp, len, "%s.new", tri.path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok = fd != -1 &&
+        trigramWriteAll(fd, &h, sizeof(h)) == 0 &&
+        trigramWriteAll(fd, start, sizeof(uint32_t) * tri.nblocks) == 0 &&
+        trigramWriteAll(fd, tri.bits, sizeof(uint64_t) * TRIGRAM_BLOCK_WORDS * (size_t)tri.nblocks) == 0;
+    if(fd != -1)
+        close(fd);
+    if(ok)
+        ok = rename(tmp, tri.path) == 0;
+    if(!ok)
+        unlink(tmp);
+    free(tmp);
+    free(start);
+}
+
+static int trigramLoad(){
+    //uses the stored index when its size, mtime and content hash are those of the file just loaded
+    struct trigramHeader want, h;
+    trigramStamp(&want);
+    //edits recovered from a swap file are not in the file the index was built from
+    if(want.magic[0] == '\0' || e.dirty)
+        return 0;
+    int fd = open(tri.path, O_RDONLY);
+    if(fd == -1)
+        return 0;
+    int ok = trigramReadAll(fd, &h, sizeof(h)) == 0 && !memcmp(h.magic, want.magic, sizeof(h.magic)) &&
+        h.size == want.size && h.mtime_sec == want.mtime_sec && h.mtime_nsec == want.mtime_nsec &&
+        h.hash == want.hash && h.blockbits == want.blockbits && h.numrows == want.numrows && h.nblocks > 0;
+    uint32_t *start = NULL;
+    uint64_t *bits = NULL;
+    if(ok){
+        start = malloc(sizeof(uint32_t) * h.nblocks);
+        bits = malloc(sizeof(uint64_t) * TRIGRAM_BLOCK_WORDS * (size_t)h.nblocks);
+        ok = start && bits && trigramReadAll(fd, start, sizeof(uint32_t) * h.nblocks) == 0 &&
+            trigramReadAll(fd, bits, sizeof(uint64_t) * TRIGRAM_BLOCK_WORDS * (size_t)h.nblocks) == 0;
+    }
+    close(fd);
+    uint32_t b;
+    for(b = 0; ok && b < h.nblocks; b++){
+        if(start[b] > h.numrows || (b > 0 && start[b] < start[b - 1]))
+            ok = 0;
+    }
+    if(!ok){
+        free(start);
+        free(bits);
+        return 0;
+    }
+    for(b = 0; b < h.nblocks; b++){
+        uint32_t y, end = b + 1 < h.nblocks ? start[b + 1] : h.numrows;
+        for(y = start[b]; y < end; y++)
+            e.row[y].block = b;
+    }
+    free(tri.bits);
+    tri.bits = bits;
+    tri.nblocks = h.nblocks;
+    tri.built = h.nblocks;
+    free(start);
+    return 1;
+}
+
+/*** hooks ***/
+
+void trigramForget(){
+    free(tri.path);
+    free(tri.bits);
+    free(tri.query);
+    memset(&tri, 0, sizeof(tri));
+}
+
+static void trigramRefile(){
+    //files the rows in fresh blocks of TRIGRAM_BLOCK_ROWS, whose filters are then built again while the editor is idle
+    int y;
+    tri.nblocks = (e.numrows + TRIGRAM_BLOCK_ROWS - 1) / TRIGRAM_BLOCK_ROWS;
+    if(tri.nblocks < 1)
+        tri.nblocks = 1;
+    free(tri.bits);
+    tri.bits = calloc((size_t)tri.nblocks * TRIGRAM_BLOCK_WORDS, sizeof(uint64_t));
+    if(!tri.bits){
+        trigramForget();
+        return;
+    }
+    tri.built = 0;
+    for(y = 0; y < e.numrows; y++)
+        e.row[y].block = y / TRIGRAM_BLOCK_ROWS;
+}
+
+void trigramOpen(const char *filename){
+    //files every row of a file that was just loaded, from the stored index when it is still good, otherwise the index is built while the editor is idle
+    struct stat st;
+    const char *env = getenv("EDITOR_INDEX");
+    trigramForget();
+    if((env && !strcmp(env, "0")) || stat(filename, &st) == -1 || st.st_size < TRIGRAM_MIN_SIZE)
+        return;
+    tri.active = 1;
+    tri.path = trigramPath(filename);
+    if(!trigramLoad())
+        trigramRefile();
+}
+
+void trigramSaved(const char *filename){
+    //the buffer was just written out, so the index now describes the file on disk again, under whatever name it was saved as
+    if(!tri.active)
+        return;
+    free(tri.path);
+    tri.path = trigramPath(filename);
+    trigramWrite();
+}
+
+void trigramRowChanged(erow *row){
+    //filters only ever gain bits, text that is gone just makes its block an occasional false candidate
+    if(tri.active && row->block >= 0 && row->block < tri.built)
+        trigramAddRow(row->block, row);
+}
+
+void trigramRowsInserted(int at, int n){
+    //new rows join the block of the row above them, which keeps the blocks in row order
+    int y;
+    if(!tri.active)
+        return;
+    //so many rows in one block would make it match every search, so a change this big is filed again from scratch
+    if(n > TRIGRAM_BLOCK_ROWS && n > e.numrows / 4){
+        trigramRefile();
+        return;
+    }
+    int block = at > 0 ? e.row[at - 1].block : (at + n < e.numrows ? e.row[at + n].block : 0);
+    for(y = at; y < at + n; y++){
+        e.row[y].block = block;
+        trigramRowChanged(&e.row[y]);
+    }
+}
+
+void trigramIdle(){
+    //builds the index a slice at a time until it is done or a key is waiting, then stores it
+    //a headless driver only queues its next key once this returns, so there it is built in one go
+    struct pollfd pfd = {e.ifd, POLLIN, 0};
+    if(!tri.active || tri.built == tri.nblocks)
+        return;
+    do{
+        trigramBuildSlice();
+    }while(tri.built < tri.nblocks && (e.headless || poll(&pfd, 1, 0) == 0));
+    if(tri.built == tri.nblocks)
+        trigramWrite();
+}
+
+/*** search ***/
+
+static void trigramPrepare(const char *query){
+    //works out the filter bits a row has to have for query to be in it
+    int i, len = strlen(query);
+    if(tri.query && !strcmp(tri.query, query))
+        return;
+    free(tri.query);
+    tri.query = strdup(query);
+    tri.numprobes = 0;
+    for(i = 0; i + 2 < len && tri.numprobes < TRIGRAM_MAX_PROBES * 2; i++){
+        trigramBits(query[i], query[i + 1], query[i + 2], &tri.probes[tri.numprobes], &tri.probes[tri.numprobes + 1]);
+        tri.numprobes += 2;
+    }
+}
+
+int trigramSkip(const char *query, int row, int direction){
+    //number of rows from row on, going in direction, that cannot hold query, stopping at the end of the file
+    if(!tri.active || row < 0 || row >= e.numrows || e.row[row].block < 0 || strlen(query) < 3)
+        return 0;
+    trigramPrepare(query);
+    int block = e.row[row].block, target;
+    if(direction > 0){
+        //the first row of the next block that may match, or the end of the file
+        while(block < tri.nblocks && !trigramBlockMayMatch(block))
+            block++;
+        target = trigramFirstRow(block);
+        return target > row ? target - row : 0;
+    }
+    //the last row of the previous block that may match, or -1
+    while(block >= 0 && !trigramBlockMayMatch(block))
+        block--;
+    target = trigramFirstRow(block + 1) - 1;
+    return target < row ? row - target : 0;
+}